@@ -0,0 +1,78 @@
+#ifndef _LINUX_DEBUGFS_STAT_H
+#define _LINUX_DEBUGFS_STAT_H
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
+
+/*
+ * Statistics files in debugfs: reading one dumps the statistics, writing
+ * anything to it resets them, so that a run can be measured on its own.
+ *
+ * DEFINE_DEBUGFS_STAT(foo) wants
+ *
+ *	static int foo_show(struct seq_file *m, void *v);
+ *	static void foo_reset(void *data);
+ *
+ * and defines foo_fops for debugfs_create_file().  The @data given there
+ * is m->private in foo_show() and @data in foo_reset().
+ */
+#define DEFINE_DEBUGFS_STAT(__name)					\
+static int __name ## _open(struct inode *inode, struct file *file)	\
+{									\
+	return single_open(file, __name ## _show, inode->i_private);	\
+}									\
+									\
+static ssize_t __name ## _write(struct file *file,			\
+				const char __user *buf,			\
+				size_t count, loff_t *ppos)		\
+{									\
+	struct seq_file *m = file->private_data;			\
+									\
+	__name ## _reset(m->private);					\
+	return count;							\
+}									\
+									\
+static const struct file_operations __name ## _fops = {		\
+	.open		= __name ## _open,				\
+	.read		= seq_read,					\
+	.write		= __name ## _write,				\
+	.llseek		= seq_lseek,					\
+	.release	= single_release,				\
+}
+
+/*
+ * Per-cpu statistics kept in a struct of nothing but unsigned longs,
+ * bumped with this_cpu_inc()/this_cpu_add() and only added up on read.
+ */
+static inline void __percpu_stat_sum(void __percpu *stat,
+				     unsigned long *sum, size_t size)
+{
+	int cpu, i;
+
+	memset(sum, 0, size);
+	for_each_possible_cpu(cpu) {
+		unsigned long *val = per_cpu_ptr(stat, cpu);
+
+		for (i = 0; i < size / sizeof(unsigned long); i++)
+			sum[i] += val[i];
+	}
+}
+
+static inline void __percpu_stat_reset(void __percpu *stat, size_t size)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(stat, cpu), 0, size);
+}
+
+/* @stat points to the per-cpu struct, @sum to a struct of the same type */
+#define percpu_stat_sum(stat, sum)					\
+	__percpu_stat_sum((stat), (unsigned long *)(sum), sizeof(*(sum)))
+
+#define percpu_stat_reset(stat)						\
+	__percpu_stat_reset((stat), sizeof(*(stat)))
+
+#endif /* _LINUX_DEBUGFS_STAT_H */
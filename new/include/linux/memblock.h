@@ -496,6 +496,12 @@ static inline unsigned long memblock_region_reserved_end_pfn(const struct memblo
 	     idx < memblock_type->cnt;					\
 	     idx++, rgn = &memblock_type->regions[idx])
 
+/* like for_each_memblock_type(), starting at region index @start */
+#define for_each_memblock_type_from(memblock_type, rgn, start)		\
+	for (idx = (start), rgn = &memblock_type->regions[idx];		\
+	     idx < memblock_type->cnt;					\
+	     idx++, rgn = &memblock_type->regions[idx])
+
 #ifdef CONFIG_MEMTEST
 extern void early_memtest(phys_addr_t start, phys_addr_t end);
 #else
@@ -575,6 +575,10 @@ struct mm_struct {
 						 * together off init_mm.mmlist, and are protected
 						 * by mmlist_lock
 						 */
+#ifdef CONFIG_LRU_GEN
+	struct hlist_node lru_gen_node;	/* Walked by multi-gen LRU aging */
+	struct mem_cgroup *lru_gen_memcg; /* Whose list lru_gen_node is on */
+#endif
 
 
 	unsigned long hiwater_rss;	/* High-watermark of RSS usage */
@@ -678,6 +682,14 @@ start_data和end_data标记了包含已初始化数据的区域. 请注意,
 	 * PROT_NONE or PROT_NUMA mapped page.
 	 */
 	bool tlb_flush_pending;
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	/*
+	 * Batched reclaim flushes: the low bits count the times reclaim
+	 * left a flush pending, the high bits the count last flushed.
+	 * See flush_tlb_batched_pending().
+	 */
+	atomic_t tlb_flush_batched;
 #endif
 	struct uprobes_state uprobes_state;
 #ifdef CONFIG_HUGETLB_PAGE
@@ -100,6 +100,13 @@ enum {
 	MIGRATE_TYPES
 };
 
+/*
+ * The pcp lists cache every migratetype for orders 0..PAGE_ALLOC_COSTLY_ORDER.
+ * List index is order * MIGRATE_PCPTYPES + migratetype.
+ */
+#define NR_PCP_ORDERS	(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS	(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 /* In mm/page_alloc.c; keep in sync also with show_migration_types() there */
 extern char * const migratetype_names[MIGRATE_TYPES];
 
@@ -309,6 +316,27 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generation LRU aging state of a lruvec, see mm/vmscan.c.
+ * Index MAX_NR_GENS of the arrays counts pages without a generation.
+ */
+#define MAX_NR_GENS	4
+
+struct lru_gen_struct {
+	unsigned long max_seq;		/* sequence of the youngest generation */
+	unsigned long min_seq;		/* no stamp is older than this */
+	unsigned long sweep_seq;	/* max_seq as the node's sweep began */
+	unsigned long timestamp;	/* jiffies of the last aging walk */
+	unsigned long walking;		/* bit 0: an aging walk is running */
+	unsigned long nr_skipped;	/* mms the last walk could not lock */
+	/* pages per generation age, as seen by the last aging walk */
+	unsigned long nr_pages[MAX_NR_GENS + 1][2];
+	/* evicted pages per generation age */
+	atomic_long_t nr_evicted[MAX_NR_GENS + 1][2];
+};
+#endif
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	/**
@@ -317,6 +345,9 @@ struct lruvec {
 	struct zone_reclaim_stat	reclaim_stat;
 	/* Evictions & activations on the inactive file list */
 	atomic_long_t			inactive_age;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -371,15 +402,15 @@ WMARK_MIN所表示的page的数量值，是在内存初始化的过程中调用f
 */
 struct per_cpu_pages {
     /* 列表中页数 */
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	// 高水线，高于此数将内存还给伙伴系统
 	int high;		/* high watermark, emptying needed */
 	// 一次性添加和删除的页面数量
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
+	/* Lists of pages, one per migrate type and order on the pcp-lists */
 	//缓存的页链表
-	struct list_head lists[MIGRATE_PCPTYPES];
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 /**
@@ -1080,6 +1111,11 @@ typedef struct pglist_data {
 	enum zone_type kcompactd_classzone_idx;
 	wait_queue_head_t kcompactd_wait;
 	struct task_struct *kcompactd;
+	/* Proactive compaction statistics, see compaction_proactiveness */
+	unsigned long proactive_compact_runs;
+	unsigned long proactive_compact_deferred;
+	unsigned long proactive_compact_migrate_scanned;
+	unsigned long proactive_compact_free_scanned;
 #endif
 #ifdef CONFIG_NUMA_BALANCING
 	/* Lock serializing the migrate rate limiting window */
@@ -1136,6 +1172,12 @@ typedef struct pglist_data {
 	unsigned long split_queue_len;
 #endif
 
+#ifdef CONFIG_LRU_GEN
+	/* Multi-gen LRU age-out sweep, see mm/vmscan.c */
+	unsigned long lru_gen_sweep_pfn;	/* offset of the next pfn */
+	unsigned long lru_gen_sweep_time;	/* jiffies of the last slice */
+#endif
+
 	/* Fields commonly accessed by the page reclaim scanner */
 	struct lruvec		lruvec;
 
@@ -160,6 +160,12 @@ private字段指向struct buffer_head
 #if defined(CONFIG_IDLE_PAGE_TRACKING) && defined(CONFIG_64BIT)
 	PG_young,
 	PG_idle,
+#endif
+#ifdef CONFIG_LRU_GEN
+	PG_lru_gen,		/* Four bits of multi-gen LRU generation, */
+	PG_lru_gen_1,		/* see mm/vmscan.c */
+	PG_lru_gen_2,
+	PG_lru_gen_3,
 #endif
 	__NR_PAGEFLAGS,
 
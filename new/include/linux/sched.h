@@ -62,6 +62,16 @@ struct sched_param {
 #include <asm/processor.h>
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: latency_nice */
+
+/*
+ * Latency nice goes from -20 (most latency sensitive) to 19 (most latency
+ * tolerant).  Unlike nice it does not change the cpu share of a task, only
+ * how eagerly CFS preempts for it, its slice and the idle cpu search.
+ */
+#define MAX_LATENCY_NICE	19
+#define MIN_LATENCY_NICE	-20
+#define LATENCY_NICE_WIDTH	(MAX_LATENCY_NICE - MIN_LATENCY_NICE + 1)
 
 /*
  * Extended scheduling parameters data structure.
@@ -98,6 +108,7 @@ struct sched_param {
  *  @sched_deadline	representative of the task's deadline
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
+ *  @sched_latency_nice	task's latency nice, with SCHED_FLAG_LATENCY_NICE
  *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
@@ -123,6 +134,9 @@ struct sched_attr {
 	u64 sched_runtime;
 	u64 sched_deadline;
 	u64 sched_period;
+
+	/* SCHED_NORMAL, SCHED_BATCH, SCHED_IDLE */
+	s32 sched_latency_nice;
 };
 
 struct futex_pi_state;
@@ -1247,6 +1261,13 @@ struct sched_domain {
 	unsigned int ttwu_wake_remote;
 	unsigned int ttwu_move_affine;
 	unsigned int ttwu_move_balance;
+
+	/* select_idle_sibling() idle mask searches, on the LLC domain */
+	unsigned int sis_core_search;
+	unsigned int sis_core_found;
+	unsigned int sis_cpu_search;
+	unsigned int sis_cpu_found;
+	unsigned int sis_scanned;	/* cpus inspected by both searches */
 #endif
 #ifdef CONFIG_SCHED_DEBUG
 	char *name;
@@ -1276,6 +1297,10 @@ static inline struct cpumask *sched_domain_span(struct sched_domain *sd)
 extern void partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 				    struct sched_domain_attr *dattr_new);
 
+/* Recompute -deadline root domain bandwidth after partition_sched_domains() */
+extern void dl_clear_root_domains(void);
+extern void dl_add_task_root_domain(struct task_struct *p);
+
 /* Allocate an array of sched domains, for partition_sched_domains(). */
 cpumask_var_t *alloc_sched_domains(unsigned int ndoms);
 void free_sched_domains(cpumask_var_t doms[], unsigned int ndoms);
@@ -1500,6 +1525,8 @@ CFS运行队列的on_rq为假。
 	u64			prev_sum_exec_runtime;
 /* 此调度实体中进程移到其他CPU组的数量 */
 	u64			nr_migrations;
+	/* MIN_LATENCY_NICE..MAX_LATENCY_NICE, of the task or of the group */
+	int			latency_nice;
 
 #ifdef CONFIG_SCHEDSTATS
     /* 用于统计一些数据 */
@@ -1587,8 +1614,11 @@ struct sched_dl_entity {
 	 *
 	 * @dl_yielded tells if task gave up the cpu before consuming
 	 * all its available runtime during the last job.
+	 *
+	 * @dl_reclaiming tells if the task, with SCHED_FLAG_RECLAIM, is
+	 * running past its runtime on bandwidth nobody else wants.
 	 */
-	int dl_throttled, dl_boosted, dl_yielded;
+	int dl_throttled, dl_boosted, dl_yielded, dl_reclaiming;
 
 	/*
 	 * Bandwidth enforcement timer. Each -deadline task has its
@@ -1716,6 +1746,10 @@ struct task_struct {
 #endif
     /* 调度策略 */
 	unsigned int policy;
+#ifdef CONFIG_SCHED_SMT
+	/* only shares a core with tasks of the same cookie, 0 is untagged */
+	unsigned long core_cookie;
+#endif
 	int nr_cpus_allowed;
 	/*
 	掩码标志的每一位对应一个系统可用的处理器
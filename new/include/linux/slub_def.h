@@ -35,6 +35,9 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	MAGAZINE_ALLOC,		/* Allocation served from the cpu magazine */
+	MAGAZINE_FREE,		/* Free parked in the cpu magazine */
+	MAGAZINE_DRAIN,		/* Magazine drained back to its slabs */
 	NR_SLUB_STAT_ITEMS };
 
 /*
@@ -68,6 +71,18 @@ struct kmem_cache_cpu {
 #endif
 };
 
+/*
+ * Optional per cpu magazine of free objects sitting in front of the cpu
+ * slab. Only used when enabled through sysfs, see mm/slub.c.
+ */
+#define SLUB_MAGAZINE_MAX	128
+#define SLUB_MAGAZINE_DEFAULT	32
+
+struct kmem_cache_magazine {
+	unsigned int count;	/* Objects currently in the magazine */
+	void *objects[SLUB_MAGAZINE_MAX];
+};
+
 /*
  * Word size structure that can be atomically updated or read and that
  * contains both the order and the number of objects that a slab of the
@@ -128,6 +143,9 @@ struct kmem_cache {
         2）当使用完每个CPU的对象数时，CPU的partial slab来自每个管理节点的对象数。
     */
 	int cpu_partial;	/* Number of per cpu partial objects to keep around */
+	struct kmem_cache_magazine __percpu *magazine;
+	int magazine_size;	/* Objects per cpu magazine before draining */
+	int magazine_enabled;	/* Magazine layer in use */
     /*
         保存slab缓冲区需要的页框数量的order值和objects数量的值，
         通过这个值可以计算出需要多少页框，这个是默认值，
@@ -57,6 +57,8 @@ struct vmap_area {
 	unsigned long va_end;
 	unsigned long flags;
 	struct rb_node rb_node;         /* address sorted rbtree */
+	unsigned long hole;             /* free space below va_start */
+	unsigned long subtree_max_hole; /* largest hole in this subtree */
 	struct list_head list;          /* address sorted list */
 	struct llist_node purge_list;    /* "lazy purge" list */
 	struct vm_struct *vm;
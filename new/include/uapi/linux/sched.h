@@ -205,5 +205,11 @@ SCHED_NORMAL普通进程策略的分化版本。采用分时策略，
  * For the sched_{set,get}attr() calls
  */
 #define SCHED_FLAG_RESET_ON_FORK	0x01
+#define SCHED_FLAG_LATENCY_NICE		0x02
+#define SCHED_FLAG_RECLAIM		0x04
+
+#define SCHED_FLAG_ALL	(SCHED_FLAG_RESET_ON_FORK | \
+			 SCHED_FLAG_LATENCY_NICE | \
+			 SCHED_FLAG_RECLAIM)
 
 #endif /* _UAPI_LINUX_SCHED_H */
@@ -529,7 +529,6 @@ static void __init mm_init(void)
 	 * 初始化slab/slub内存分配器
 	 */
 	kmem_cache_init();
-	percpu_init_late();
 	//页表相关的初始化，其实就是创建一个slab分配器，用于页表锁的分配。
 	pgtable_init();
 	//初始化vmalloc用到的数据结构
@@ -12,6 +12,7 @@
 #include <linux/context_tracking.h>
 
 #include <linux/blkdev.h>
+#include <linux/debugfs_stat.h>
 #include <linux/kprobes.h>
 #include <linux/mmu_context.h>
 #include <linux/module.h>
@@ -55,6 +56,12 @@ const_debug unsigned int sysctl_sched_features =
  */
 const_debug unsigned int sysctl_sched_nr_migrate = 32;
 
+/*
+ * Skip the reschedule IPI for a remote wakeup when the target cpu is
+ * already running sched_ttwu_pending() and will see the new entry.
+ */
+const_debug unsigned int sysctl_sched_ttwu_coalesce = 1;
+
 /*
  * period over which we average the RT time consumption, measured
  * in ms.
@@ -643,6 +650,17 @@ bool sched_can_stop_tick(struct rq *rq)
 	if (rq->dl.dl_nr_running)
 		return false;
 
+#ifdef CONFIG_SCHED_SMT
+	/* A sibling we keep forced idle waits on sched_core_tick() */
+	if (rq->core_occupied) {
+		int i;
+
+		for_each_cpu(i, cpu_smt_mask(cpu_of(rq)))
+			if (READ_ONCE(cpu_rq(i)->core_forceidle_start))
+				return false;
+	}
+#endif
+
 	/*
 	 * If there are more than one RR tasks, we need the tick to effect the
 	 * actual RR behaviour.
@@ -919,6 +937,13 @@ void check_preempt_curr(struct rq *rq, struct task_struct *p, int flags)
 		}
 	}
 
+	/*
+	 * A -deadline task running on reclaimed bandwidth gives it back as
+	 * soon as anybody else is runnable, see dl_reclaim().
+	 */
+	if (unlikely(dl_task(rq->curr) && rq->curr->dl.dl_reclaiming))
+		resched_curr(rq);
+
 	/*
 	 * A queue event has occurred, and we're going to schedule.  In
 	 * this case, we can save a useless back to back clock update.
@@ -1724,6 +1749,12 @@ static int ttwu_remote(struct task_struct *p, int wake_flags)
 }
 
 #ifdef CONFIG_SMP
+/*
+ * Passes over the wake list with wake_list_busy set, bounding how long
+ * a stream of IPI-less wakeups can keep this cpu here with irqs off.
+ */
+#define WAKE_LIST_BUSY_PASSES	8
+
 void sched_ttwu_pending(void)
 {
 	struct rq *rq = this_rq();
@@ -1731,6 +1762,8 @@ void sched_ttwu_pending(void)
 	struct task_struct *p;
 	unsigned long flags;
 	struct rq_flags rf;
+	int passes = 0;
+	bool busy = true;
 
 	if (!llist)
 		return;
@@ -1738,6 +1771,16 @@ void sched_ttwu_pending(void)
 	raw_spin_lock_irqsave(&rq->lock, flags);
 	rq_pin_lock(rq, &rf);
 
+	/*
+	 * Wakers that find the list busy add to it without an IPI, so it is
+	 * drained again until it stays empty, for at most
+	 * WAKE_LIST_BUSY_PASSES passes.  The busy flag is cleared before the
+	 * last check; paired with the full barrier of llist_add() in
+	 * ttwu_queue_remote(), either the waker sees it clear and sends the
+	 * IPI or the entry is seen here.
+	 */
+	WRITE_ONCE(rq->wake_list_busy, 1);
+again:
 	while (llist) {
 		int wake_flags = 0;
 
@@ -1750,6 +1793,22 @@ void sched_ttwu_pending(void)
 		ttwu_do_activate(rq, p, wake_flags, &rf);
 	}
 
+	if (busy) {
+		if (++passes < WAKE_LIST_BUSY_PASSES) {
+			llist = llist_del_all(&rq->wake_list);
+			if (llist)
+				goto again;
+		}
+
+		/* Later wakers send their IPI, take what came before that */
+		busy = false;
+		WRITE_ONCE(rq->wake_list_busy, 0);
+		smp_mb();
+		llist = llist_del_all(&rq->wake_list);
+		if (llist)
+			goto again;
+	}
+
 	rq_unpin_lock(rq, &rf);
 	raw_spin_unlock_irqrestore(&rq->lock, flags);
 }
@@ -1797,15 +1856,71 @@ static void ttwu_queue_remote(struct task_struct *p, int cpu, int wake_flags)
 	struct rq *rq = cpu_rq(cpu);
 
 	p->sched_remote_wakeup = !!(wake_flags & WF_MIGRATED);
+	schedstat_inc(this_rq()->ttwu_queued);
 
 	if (llist_add(&p->wake_entry, &cpu_rq(cpu)->wake_list)) {
-		if (!set_nr_if_polling(rq->idle))
-			smp_send_reschedule(cpu);
-		else
+		if (set_nr_if_polling(rq->idle)) {
 			trace_sched_wake_idle_without_ipi(cpu);
+		} else if (sysctl_sched_ttwu_coalesce &&
+			   READ_ONCE(rq->wake_list_busy)) {
+			/* See sched_ttwu_pending() */
+			schedstat_inc(this_rq()->ttwu_ipi_coalesced);
+		} else {
+			schedstat_inc(this_rq()->ttwu_ipi);
+			smp_send_reschedule(cpu);
+		}
 	}
 }
 
+#ifdef CONFIG_DEBUG_FS
+#ifdef CONFIG_SCHEDSTATS
+static int sched_ttwu_stat_show(struct seq_file *m, void *v)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		seq_printf(m, "cpu%d queued %u ipi %u ipi_coalesced %u\n",
+			   cpu, rq->ttwu_queued, rq->ttwu_ipi,
+			   rq->ttwu_ipi_coalesced);
+	}
+	return 0;
+}
+
+static void sched_ttwu_stat_reset(void *data)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cpu_rq(cpu)->ttwu_queued = 0;
+		cpu_rq(cpu)->ttwu_ipi = 0;
+		cpu_rq(cpu)->ttwu_ipi_coalesced = 0;
+	}
+}
+
+DEFINE_DEBUGFS_STAT(sched_ttwu_stat);
+#endif /* CONFIG_SCHEDSTATS */
+
+static int __init sched_ttwu_debugfs(void)
+{
+#ifdef CONFIG_SCHEDSTATS
+	/* Counted on the waking cpu, and only while schedstats are enabled */
+	if (!debugfs_create_file("sched_ttwu", 0600, NULL, NULL,
+				 &sched_ttwu_stat_fops))
+		return -ENOMEM;
+#endif
+#ifdef CONFIG_SCHED_DEBUG
+	/* const_debug knobs are only writable with CONFIG_SCHED_DEBUG */
+	if (!debugfs_create_u32("sched_ttwu_coalesce", 0644, NULL,
+				&sysctl_sched_ttwu_coalesce))
+		return -ENOMEM;
+#endif
+	return 0;
+}
+late_initcall(sched_ttwu_debugfs);
+#endif /* CONFIG_DEBUG_FS */
+
 void wake_up_if_idle(int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
@@ -2164,6 +2279,7 @@ void __dl_clear_params(struct task_struct *p)
 
 	dl_se->dl_throttled = 0;
 	dl_se->dl_yielded = 0;
+	dl_se->dl_reclaiming = 0;
 }
 
 /*
@@ -2379,6 +2495,9 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 		} else if (PRIO_TO_NICE(p->static_prio) < 0)
 			p->static_prio = NICE_TO_PRIO(0);
 
+		if (p->se.latency_nice < 0)
+			p->se.latency_nice = 0;
+
 		p->prio = p->normal_prio = __normal_prio(p);
 		set_load_weight(p);
 
@@ -3124,6 +3243,7 @@ void scheduler_tick(void)
 	curr->sched_class->task_tick(rq, curr, 0);
 	cpu_load_update_active(rq);
 	calc_global_load_tick(rq);
+	sched_core_tick(rq);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -3333,6 +3453,323 @@ again:
 	BUG();
 }
 
+#ifdef CONFIG_SCHED_SMT
+/*
+ * Core scheduling: SMT siblings only run tasks with the same cookie at the
+ * same time, so that mutually untrusted tasks never share a core.  Tasks
+ * get cookies through the cpu cgroup's core_tag file; untagged tasks have
+ * cookie 0, which again only matches itself.
+ * Idle and stop tasks go with anything.
+ *
+ * After pick_next_task() each cpu checks its pick against what its
+ * siblings run, or are forced idle waiting to run, and the more important
+ * task of a conflicting pair gets the core: a deadline task before an rt
+ * task, an rt task before a fair one, and SCHED_IDLE tasks last.  A cpu
+ * that loses goes idle; a sibling that loses is made to pick again.  The
+ * check is done holding the core_lock of every sibling, so two siblings
+ * can not both commit to conflicting tasks.  A cpu changing what it runs
+ * kicks the siblings that were forced idle and may now run their task.
+ *
+ * Fair tasks of different cpus compare equal.  Between equals the task
+ * already running keeps the core, until a sibling has been forced idle
+ * for longer than sysctl_sched_core_forceidle_max; then the others yield
+ * to it, so contending cookies take turns instead of one of them
+ * starving.  sched_core_tick() enforces that, and a nohz_full sibling
+ * keeps its tick while it keeps another sibling idle.
+ */
+#define SCHED_CORE_MAX_SIBLINGS	8
+
+static DEFINE_STATIC_KEY_FALSE(__sched_core_enabled);
+static atomic_long_t sched_core_cookie_seq;
+
+const_debug unsigned int sysctl_sched_core_forceidle_max = 4000000UL;
+
+static inline bool sched_core_enabled(void)
+{
+	return static_branch_unlikely(&__sched_core_enabled);
+}
+
+/* Lower is more important; fair tasks of different cpus compare equal */
+static inline int sched_core_prio(struct task_struct *p)
+{
+	if (p->policy == SCHED_IDLE)
+		return MAX_PRIO;
+	if (rt_prio(p->prio))	/* includes deadline */
+		return p->prio;
+	return DEFAULT_PRIO;
+}
+
+/* Whether a task of @prio and @deadline has to run before one of @oprio */
+static inline bool sched_core_before(int prio, u64 deadline,
+				     int oprio, u64 odeadline)
+{
+	if (prio != oprio)
+		return prio < oprio;
+	return dl_prio(prio) && dl_time_before(deadline, odeadline);
+}
+
+static void sched_core_kick(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	/* A forced idle cpu runs its idle task, which is always there */
+	if (set_nr_and_not_polling(rq->idle))
+		smp_send_reschedule(cpu);
+}
+
+static void __sched_core_preempt(void *arg)
+{
+	struct rq *rq = arg;
+
+	WRITE_ONCE(rq->core_csd_pending, 0);
+	raw_spin_lock(&rq->lock);
+	resched_curr(rq);
+	raw_spin_unlock(&rq->lock);
+}
+
+/*
+ * Make a sibling running a less important task pick again, which will
+ * find ours and go idle.  Its rq->lock can't be taken under ours, so the
+ * resched is done on the sibling itself.  Called with the sibling's
+ * core_lock held.
+ */
+static void sched_core_preempt(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	if (rq->core_csd_pending)
+		return;
+	rq->core_csd_pending = 1;
+	smp_call_function_single_async(cpu, &rq->core_csd);
+}
+
+static struct task_struct *
+sched_core_pick(struct rq *rq, struct task_struct *next, struct rq_flags *rf)
+{
+	int sib[SCHED_CORE_MAX_SIBLINGS];
+	int cpu = cpu_of(rq);
+	bool occupied, forced = false;
+	unsigned int preempt = 0;
+	unsigned long cookie;
+	int prio = MAX_PRIO;
+	u64 deadline = 0, now;
+	int i, n = 0;
+
+	occupied = !is_idle_task(next) && next->sched_class != &stop_sched_class;
+	cookie = occupied ? READ_ONCE(next->core_cookie) : 0;
+	if (occupied) {
+		prio = sched_core_prio(next);
+		deadline = next->dl.deadline;
+	}
+
+	if (!sched_core_enabled() ||
+	    !cpumask_test_cpu(cpu, cpu_smt_mask(cpu)))
+		goto publish;
+
+	for_each_cpu(i, cpu_smt_mask(cpu)) {
+		if (WARN_ON_ONCE(n == SCHED_CORE_MAX_SIBLINGS))
+			break;
+		sib[n++] = i;
+	}
+
+	for (i = 0; i < n; i++)
+		raw_spin_lock_nested(&cpu_rq(sib[i])->core_lock, i);
+
+	now = local_clock();
+	for (i = 0; occupied && i < n; i++) {
+		struct rq *srq = cpu_rq(sib[i]);
+		u64 start = srq->core_forceidle_start;
+
+		if (srq == rq)
+			continue;
+
+		/* Runs a task we can't share the core with */
+		if (srq->core_occupied && srq->core_cookie != cookie) {
+			if (sched_core_before(prio, deadline, srq->core_prio,
+					      srq->core_deadline)) {
+				preempt |= 1U << i;
+				continue;
+			}
+			forced = true;
+			break;
+		}
+
+		if (!start || srq->core_wait_cookie == cookie)
+			continue;
+
+		/*
+		 * Kept idle by a different cookie: yield to its task if it is
+		 * more important, or as important and waiting for too long.
+		 */
+		if (sched_core_before(srq->core_wait_prio,
+				      srq->core_wait_deadline, prio, deadline) ||
+		    (!sched_core_before(prio, deadline, srq->core_wait_prio,
+					srq->core_wait_deadline) &&
+		     now - start > sysctl_sched_core_forceidle_max &&
+		     (!rq->core_forceidle_start ||
+		      start < rq->core_forceidle_start))) {
+			forced = true;
+			break;
+		}
+	}
+
+	if (forced) {
+		if (!rq->core_forceidle_start) {
+			WRITE_ONCE(rq->core_forceidle_start, now);
+			rq->core_forceidle_count++;
+		}
+		rq->core_wait_cookie = cookie;
+		rq->core_wait_prio = prio;
+		rq->core_wait_deadline = deadline;
+		occupied = false;
+		cookie = 0;
+		preempt = 0;
+	} else if (rq->core_forceidle_start) {
+		rq->core_forceidle_sum += now - rq->core_forceidle_start;
+		WRITE_ONCE(rq->core_forceidle_start, 0);
+	}
+
+	rq->core_occupied = occupied;
+	rq->core_cookie = cookie;
+	rq->core_prio = prio;
+	rq->core_deadline = deadline;
+
+	for (i = 0; i < n; i++) {
+		struct rq *srq = cpu_rq(sib[i]);
+
+		if (srq == rq)
+			continue;
+
+		if (preempt & (1U << i)) {
+			sched_core_preempt(sib[i]);
+		} else if (srq->core_forceidle_start &&
+			   (!occupied || srq->core_wait_cookie == cookie ||
+			    sched_core_before(srq->core_wait_prio,
+					      srq->core_wait_deadline,
+					      prio, deadline))) {
+			sched_core_kick(sib[i]);
+		} else if (forced && srq->core_occupied &&
+			   tick_nohz_full_cpu(sib[i])) {
+			/* sched_core_tick() has to run there to end our wait */
+			tick_nohz_dep_set_cpu(sib[i], TICK_DEP_BIT_SCHED);
+		}
+	}
+
+	for (i = n - 1; i >= 0; i--)
+		raw_spin_unlock(&cpu_rq(sib[i])->core_lock);
+
+	/* Puts @next back and picks the idle task */
+	if (forced)
+		next = idle_sched_class.pick_next_task(rq, next, rf);
+	return next;
+
+publish:
+	rq->core_occupied = occupied;
+	rq->core_cookie = cookie;
+	rq->core_prio = prio;
+	rq->core_deadline = deadline;
+	return next;
+}
+
+/* Make a cpu that keeps a sibling idle for too long pick again */
+static void sched_core_tick(struct rq *rq)
+{
+	u64 now;
+	int i;
+
+	if (!sched_core_enabled() || !rq->core_occupied)
+		return;
+
+	now = local_clock();
+	for_each_cpu(i, cpu_smt_mask(cpu_of(rq))) {
+		u64 start = READ_ONCE(cpu_rq(i)->core_forceidle_start);
+
+		if (start && now - start > sysctl_sched_core_forceidle_max) {
+			resched_curr(rq);
+			return;
+		}
+	}
+
+	/* Nobody waits on us any more, a nohz_full cpu may stop the tick */
+	sched_update_tick_dependency(rq);
+}
+
+static unsigned long sched_core_alloc_cookie(void)
+{
+	static_branch_enable(&__sched_core_enabled);
+	return atomic_long_inc_return(&sched_core_cookie_seq);
+}
+
+/*
+ * Once enabled core scheduling stays enabled; only a non-zero cookie, which
+ * comes from sched_core_alloc_cookie(), can be set before that.
+ */
+static void sched_core_set_cookie(struct task_struct *p, unsigned long cookie)
+{
+	struct rq_flags rf;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &rf);
+	WRITE_ONCE(p->core_cookie, cookie);
+	/* Let its cpu check the new cookie against the siblings */
+	if (task_running(rq, p))
+		resched_curr(rq);
+	task_rq_unlock(rq, p, &rf);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int sched_core_stat_show(struct seq_file *m, void *v)
+{
+	u64 now = local_clock();
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		u64 start = READ_ONCE(rq->core_forceidle_start);
+		u64 sum = rq->core_forceidle_sum;
+
+		/* Include the current forced idle period */
+		if (start && now > start)
+			sum += now - start;
+
+		seq_printf(m, "cpu%d forceidle %u forceidle_ns %llu\n",
+			   cpu, rq->core_forceidle_count, sum);
+	}
+	return 0;
+}
+
+static void sched_core_stat_reset(void *data)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cpu_rq(cpu)->core_forceidle_count = 0;
+		cpu_rq(cpu)->core_forceidle_sum = 0;
+	}
+}
+
+DEFINE_DEBUGFS_STAT(sched_core_stat);
+
+static int __init sched_core_stat_debugfs(void)
+{
+	if (!debugfs_create_file("sched_core", 0600, NULL, NULL,
+				 &sched_core_stat_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(sched_core_stat_debugfs);
+#endif /* CONFIG_DEBUG_FS */
+
+#else /* !CONFIG_SCHED_SMT */
+static inline struct task_struct *
+sched_core_pick(struct rq *rq, struct task_struct *next, struct rq_flags *rf)
+{
+	return next;
+}
+
+static inline void sched_core_tick(struct rq *rq) { }
+#endif /* CONFIG_SCHED_SMT */
+
 /*
  * __schedule() is the main scheduler function.
  *
@@ -3438,6 +3875,7 @@ static void __sched notrace __schedule(bool preempt)
 
     // 挑选最高优先级的任务
 	next = pick_next_task(rq, prev, &rf);
+	next = sched_core_pick(rq, next, &rf);
 	clear_tsk_need_resched(prev);
 	clear_preempt_need_resched();
 
@@ -4013,6 +4451,9 @@ static void __setscheduler_params(struct task_struct *p,
 	else if (fair_policy(policy))
 		p->static_prio = NICE_TO_PRIO(attr->sched_nice);
 
+	if (attr->sched_flags & SCHED_FLAG_LATENCY_NICE)
+		p->se.latency_nice = attr->sched_latency_nice;
+
 	/*
 	 * __sched_setscheduler() ensures attr->sched_priority == 0 when
 	 * !rt_policy. Always setting this ensures that things like
@@ -4156,7 +4597,12 @@ recheck:
 			return -EINVAL;
 	}
 
-	if (attr->sched_flags & ~(SCHED_FLAG_RESET_ON_FORK))
+	if (attr->sched_flags & ~(SCHED_FLAG_ALL))
+		return -EINVAL;
+
+	if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+	    (attr->sched_latency_nice < MIN_LATENCY_NICE ||
+	     attr->sched_latency_nice > MAX_LATENCY_NICE))
 		return -EINVAL;
 
 	/*
@@ -4181,6 +4627,11 @@ recheck:
 				return -EPERM;
 		}
 
+		/* Can't become more latency sensitive: */
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice < p->se.latency_nice)
+			return -EPERM;
+
 		if (rt_policy(policy)) {
 			unsigned long rlim_rtprio =
 					task_rlimit(p, RLIMIT_RTPRIO);
@@ -4257,6 +4708,9 @@ recheck:
 			goto change;
 		if (dl_policy(policy) && dl_param_changed(p, attr))
 			goto change;
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice != p->se.latency_nice)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		task_rq_unlock(rq, p, &rf);
@@ -4513,6 +4967,10 @@ static int sched_copy_attr(struct sched_attr __user *uattr, struct sched_attr *a
 	 */
 	attr->sched_nice = clamp(attr->sched_nice, MIN_NICE, MAX_NICE);
 
+	if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+	    size < SCHED_ATTR_SIZE_VER1)
+		return -EINVAL;
+
 	return 0;
 
 err_size:
@@ -4728,6 +5186,10 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 	else
 		attr.sched_nice = task_nice(p);
 
+	/* Old user-space asking for the short struct does not get it */
+	if (size >= SCHED_ATTR_SIZE_VER1)
+		attr.sched_latency_nice = p->se.latency_nice;
+
 	rcu_read_unlock();
 
 	retval = sched_read_attr(uattr, &attr, size);
@@ -5992,6 +6454,8 @@ static struct kmem_cache *task_group_cache __read_mostly;
 
 DECLARE_PER_CPU(cpumask_var_t, load_balance_mask);
 DECLARE_PER_CPU(cpumask_var_t, select_idle_mask);
+DECLARE_PER_CPU(cpumask_var_t, llc_idle_mask);
+DECLARE_PER_CPU(cpumask_var_t, llc_idle_core_mask);
 
 #define WAIT_TABLE_BITS 8
 #define WAIT_TABLE_SIZE (1 << WAIT_TABLE_BITS)
@@ -6048,6 +6512,10 @@ void __init sched_init(void)
 			cpumask_size(), GFP_KERNEL, cpu_to_node(i));
 		per_cpu(select_idle_mask, i) = (cpumask_var_t)kzalloc_node(
 			cpumask_size(), GFP_KERNEL, cpu_to_node(i));
+		per_cpu(llc_idle_mask, i) = (cpumask_var_t)kzalloc_node(
+			cpumask_size(), GFP_KERNEL, cpu_to_node(i));
+		per_cpu(llc_idle_core_mask, i) = (cpumask_var_t)kzalloc_node(
+			cpumask_size(), GFP_KERNEL, cpu_to_node(i));
 	}
 #endif /* CONFIG_CPUMASK_OFFSTACK */
 
@@ -6077,6 +6545,11 @@ void __init sched_init(void)
 
 		rq = cpu_rq(i);
 		raw_spin_lock_init(&rq->lock);
+#ifdef CONFIG_SCHED_SMT
+		raw_spin_lock_init(&rq->core_lock);
+		rq->core_csd.func = __sched_core_preempt;
+		rq->core_csd.info = rq;
+#endif
 		rq->nr_running = 0;
 		rq->calc_load_active = 0;
 		rq->calc_load_update = jiffies + LOAD_FREQ;
@@ -6952,10 +7425,57 @@ static void cpu_cgroup_attach(struct cgroup_taskset *tset)
 	struct task_struct *task;
 	struct cgroup_subsys_state *css;
 
-	cgroup_taskset_for_each(task, css, tset)
+	cgroup_taskset_for_each(task, css, tset) {
 		sched_move_task(task);
+#ifdef CONFIG_SCHED_SMT
+		/* Take the new group's cookie, 0 when it is not tagged */
+		if (READ_ONCE(task->core_cookie) != css_tg(css)->core_cookie)
+			sched_core_set_cookie(task, css_tg(css)->core_cookie);
+#endif
+	}
+}
+
+#ifdef CONFIG_SCHED_SMT
+static u64 cpu_core_tag_read_u64(struct cgroup_subsys_state *css,
+				 struct cftype *cft)
+{
+	return !!css_tg(css)->core_cookie;
 }
 
+/*
+ * Tagging gives the group's tasks, and tasks attached later, a cookie of
+ * their own; untagging gives them cookie 0.  Child groups are tagged on
+ * their own.
+ */
+static int cpu_core_tag_write_u64(struct cgroup_subsys_state *css,
+				  struct cftype *cft, u64 val)
+{
+	struct task_group *tg = css_tg(css);
+	struct css_task_iter it;
+	struct task_struct *p;
+	unsigned long cookie;
+
+	if (val > 1)
+		return -ERANGE;
+
+	if (tg == &root_task_group)
+		return -EINVAL;
+
+	if (!!tg->core_cookie == val)
+		return 0;
+
+	cookie = val ? sched_core_alloc_cookie() : 0;
+	tg->core_cookie = cookie;
+
+	css_task_iter_start(css, &it);
+	while ((p = css_task_iter_next(&it)))
+		sched_core_set_cookie(p, cookie);
+	css_task_iter_end(&it);
+
+	return 0;
+}
+#endif /* CONFIG_SCHED_SMT */
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 static int cpu_shares_write_u64(struct cgroup_subsys_state *css,
 				struct cftype *cftype, u64 shareval)
@@ -6971,6 +7491,18 @@ static u64 cpu_shares_read_u64(struct cgroup_subsys_state *css,
 	return (u64) scale_load_down(tg->shares);
 }
 
+static int cpu_latency_nice_write_s64(struct cgroup_subsys_state *css,
+				      struct cftype *cft, s64 latency_nice)
+{
+	return sched_group_set_latency(css_tg(css), latency_nice);
+}
+
+static s64 cpu_latency_nice_read_s64(struct cgroup_subsys_state *css,
+				     struct cftype *cft)
+{
+	return css_tg(css)->latency_nice;
+}
+
 #ifdef CONFIG_CFS_BANDWIDTH
 static DEFINE_MUTEX(cfs_constraints_mutex);
 
@@ -7249,6 +7781,19 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency_nice",
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
+#endif
+#ifdef CONFIG_SCHED_SMT
+	{
+		.name = "core_tag",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_core_tag_read_u64,
+		.write_u64 = cpu_core_tag_write_u64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
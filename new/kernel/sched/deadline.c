@@ -697,6 +697,52 @@ int dl_runtime_exceeded(struct sched_dl_entity *dl_se)
 
 extern bool sched_rt_bandwidth_account(struct rt_rq *rt_rq);
 
+/*
+ * Bandwidth reclaiming: a task with SCHED_FLAG_RECLAIM that exhausted its
+ * runtime is not throttled while it is the only runnable task on its cpu,
+ * since the bandwidth it goes on using is then left unused by every other
+ * reservation (and by everybody else).  This is the idle-time subset of
+ * GRUB: it needs no tracking of inactive bandwidth, and can't make an
+ * admitted task miss its deadline, because the overrun ends as soon as
+ * anybody else becomes runnable (see check_preempt_curr()).
+ *
+ * The overrun is not charged to the next instance; if the task outlives
+ * its deadline it gets a new instance right away.
+ *
+ * While reclaiming, the task keeps the deadline of the instance it
+ * overran, but it is not urgent work: the cpu is taken out of cpudl so
+ * that find_later_rq() sees it as free.  Any dequeue, throttle or
+ * replenishment ends the overrun and puts the cpu back through
+ * inc/dec_dl_deadline().
+ */
+static bool dl_reclaim(struct rq *rq, struct task_struct *p)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	if (!(dl_se->flags & SCHED_FLAG_RECLAIM) || dl_se->dl_yielded ||
+	    dl_se->dl_boosted || rq->nr_running > 1)
+		return false;
+
+	if (!dl_se->dl_reclaiming) {
+		rq->dl.nr_reclaims++;
+#ifdef CONFIG_SMP
+		if (rq->online)
+			cpudl_clear(&rq->rd->cpudl, rq->cpu);
+#endif
+	}
+	rq->dl.reclaimed += -dl_se->runtime;
+	dl_se->runtime = 0;
+	dl_se->dl_reclaiming = 1;
+
+	if (dl_time_before(dl_se->deadline, rq_clock(rq))) {
+		dl_se->dl_reclaiming = 0;
+		__dequeue_task_dl(rq, p, 0);
+		enqueue_task_dl(rq, p, ENQUEUE_REPLENISH);
+	}
+
+	return true;
+}
+
 /*
  * Update the current task's runtime statistics (provided it is still
  * a -deadline task and has not been removed from the dl_rq).
@@ -742,8 +788,10 @@ static void update_curr_dl(struct rq *rq)
 	dl_se->runtime -= delta_exec;
 
 throttle:
-	if (dl_runtime_exceeded(dl_se) || dl_se->dl_yielded) {
+	if ((dl_runtime_exceeded(dl_se) && !dl_reclaim(rq, curr)) ||
+	    dl_se->dl_yielded) {
 		dl_se->dl_throttled = 1;
+		dl_se->dl_reclaiming = 0;
 		__dequeue_task_dl(rq, curr, 0);
 		if (unlikely(dl_se->dl_boosted || !start_dl_timer(curr)))
 			enqueue_task_dl(rq, curr, ENQUEUE_REPLENISH);
@@ -971,6 +1019,8 @@ static void __dequeue_task_dl(struct rq *rq, struct task_struct *p, int flags)
 static void dequeue_task_dl(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_curr_dl(rq);
+	/* Blocking or leaving the rq ends an overrun, see dl_reclaim() */
+	p->dl.dl_reclaiming = 0;
 	__dequeue_task_dl(rq, p, flags);
 }
 
@@ -1652,6 +1702,52 @@ static void set_cpus_allowed_dl(struct task_struct *p,
 	set_cpus_allowed_common(p, new_mask);
 }
 
+/*
+ * Rebuilding the sched domains may replace root domains, and with them
+ * the -deadline bandwidth admitted in them.  The cpuset code recomputes
+ * it afterwards: dl_clear_root_domains() and then dl_add_task_root_domain()
+ * for every task.
+ */
+void dl_clear_root_domains(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	raw_spin_lock_irqsave(&def_root_domain.dl_bw.lock, flags);
+	def_root_domain.dl_bw.total_bw = 0;
+	raw_spin_unlock_irqrestore(&def_root_domain.dl_bw.lock, flags);
+
+	rcu_read_lock_sched();
+	for_each_possible_cpu(cpu) {
+		struct dl_bw *dl_b = dl_bw_of(cpu);
+
+		raw_spin_lock_irqsave(&dl_b->lock, flags);
+		dl_b->total_bw = 0;
+		raw_spin_unlock_irqrestore(&dl_b->lock, flags);
+	}
+	rcu_read_unlock_sched();
+}
+
+void dl_add_task_root_domain(struct task_struct *p)
+{
+	struct rq_flags rf;
+	struct dl_bw *dl_b;
+	struct rq *rq;
+
+	raw_spin_lock_irqsave(&p->pi_lock, rf.flags);
+	if (!dl_task(p)) {
+		raw_spin_unlock_irqrestore(&p->pi_lock, rf.flags);
+		return;
+	}
+
+	rq = __task_rq_lock(p, &rf);
+	dl_b = &rq->rd->dl_bw;
+	raw_spin_lock(&dl_b->lock);
+	__dl_add(dl_b, p->dl.dl_bw);
+	raw_spin_unlock(&dl_b->lock);
+	task_rq_unlock(rq, p, &rf);
+}
+
 /* Assumes rq->lock is held */
 static void rq_online_dl(struct rq *rq)
 {
@@ -1659,7 +1755,8 @@ static void rq_online_dl(struct rq *rq)
 		dl_set_overload(rq);
 
 	cpudl_set_freecpu(&rq->rd->cpudl, rq->cpu);
-	if (rq->dl.dl_nr_running > 0)
+	if (rq->dl.dl_nr_running > 0 &&
+	    !(dl_task(rq->curr) && rq->curr->dl.dl_reclaiming))
 		cpudl_set(&rq->rd->cpudl, rq->cpu, rq->dl.earliest_dl.curr);
 }
 
@@ -1812,6 +1909,23 @@ extern void print_dl_rq(struct seq_file *m, int cpu, struct dl_rq *dl_rq);
 
 void print_dl_stats(struct seq_file *m, int cpu)
 {
-	print_dl_rq(m, cpu, &cpu_rq(cpu)->dl);
+	struct dl_rq *dl_rq = &cpu_rq(cpu)->dl;
+#ifdef CONFIG_SMP
+	struct dl_bw *dl_b;
+#endif
+
+	print_dl_rq(m, cpu, dl_rq);
+	seq_printf(m, "  .%-30s: %Ld\n", "reclaimed",
+		   (long long)dl_rq->reclaimed);
+	seq_printf(m, "  .%-30s: %ld\n", "nr_reclaims",
+		   (long)dl_rq->nr_reclaims);
+#ifdef CONFIG_SMP
+	rcu_read_lock_sched();
+	dl_b = dl_bw_of(cpu);
+	seq_printf(m, "  .%-30s: %Ld\n", "dl_bw->bw", (long long)dl_b->bw);
+	seq_printf(m, "  .%-30s: %Ld\n", "dl_bw->total_bw",
+		   (long long)dl_b->total_bw);
+	rcu_read_unlock_sched();
+#endif
 }
 #endif /* CONFIG_SCHED_DEBUG */
@@ -30,6 +30,7 @@
 #include <linux/mempolicy.h>
 #include <linux/migrate.h>
 #include <linux/task_work.h>
+#include <linux/debugfs_stat.h>
 
 #include <trace/events/sched.h>
 
@@ -3822,6 +3823,20 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 	s64 delta;
 
 	ideal_runtime = sched_slice(cfs_rq, curr);
+	/*
+	 * Latency sensitive entities run in shorter slices, so that they
+	 * come back sooner rather than run for longer.  Not below the
+	 * minimum granularity, unless the slice already was.
+	 */
+	if (curr->latency_nice < 0) {
+		unsigned long floor = min_t(unsigned long, ideal_runtime,
+					    sysctl_sched_min_granularity);
+
+		ideal_runtime = ideal_runtime *
+			(MAX_LATENCY_NICE + 1 + curr->latency_nice) /
+			(MAX_LATENCY_NICE + 1);
+		ideal_runtime = max(ideal_runtime, floor);
+	}
 	delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
 	if (delta_exec > ideal_runtime) {
 		resched_curr(rq_of(cfs_rq));
@@ -4965,6 +4980,18 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 DEFINE_PER_CPU(cpumask_var_t, load_balance_mask);
 DEFINE_PER_CPU(cpumask_var_t, select_idle_mask);
 
+/*
+ * Idle cpus (and cpus of fully idle cores) of each LLC, so that
+ * select_idle_sibling() does not have to walk the whole LLC span on every
+ * wakeup.  The masks of an LLC live in the per-cpu slot of its first cpu,
+ * sd_llc_id.  They are maintained on idle entry and exit, and refreshed
+ * from the idle loop so that a cpu already idle when its sd_llc_id changed
+ * (domain rebuild, hotplug) shows up in its new slot.  They are only
+ * hints: every candidate is still checked with idle_cpu().
+ */
+DEFINE_PER_CPU(cpumask_var_t, llc_idle_mask);
+DEFINE_PER_CPU(cpumask_var_t, llc_idle_core_mask);
+
 #ifdef CONFIG_NO_HZ_COMMON
 /*
  * per rq 'load' arrray crap; XXX kill this.
@@ -5746,6 +5773,49 @@ again:
 		(cpu) = cpumask_next_wrap((cpu), (mask), (start), &(wrap)),	\
 		(cpu) < nr_cpumask_bits; )
 
+static inline struct cpumask *llc_idle_cpus(int cpu)
+{
+	return per_cpu(llc_idle_mask, per_cpu(sd_llc_id, cpu));
+}
+
+static inline struct cpumask *llc_idle_cores(int cpu)
+{
+	return per_cpu(llc_idle_core_mask, per_cpu(sd_llc_id, cpu));
+}
+
+/*
+ * Called with @idle set when @rq picks its idle task and cleared when it
+ * stops running it.  The masks are shared by the whole LLC, so test first
+ * to avoid dirtying the cacheline when nothing changes.
+ */
+void update_idle_mask(struct rq *rq, bool idle)
+{
+	int cpu = cpu_of(rq);
+	struct cpumask *idle_cpus = llc_idle_cpus(cpu);
+
+	if (idle) {
+		if (!cpumask_test_cpu(cpu, idle_cpus))
+			cpumask_set_cpu(cpu, idle_cpus);
+		return;
+	}
+
+	if (cpumask_test_cpu(cpu, idle_cpus))
+		cpumask_clear_cpu(cpu, idle_cpus);
+
+#ifdef CONFIG_SCHED_SMT
+	if (static_branch_likely(&sched_smt_present)) {
+		struct cpumask *idle_cores = llc_idle_cores(cpu);
+		int sibling;
+
+		if (!cpumask_test_cpu(cpu, idle_cores))
+			return;
+		/* The core is busy again; the bits are shared, clear atomically */
+		for_each_cpu(sibling, cpu_smt_mask(cpu))
+			cpumask_clear_cpu(sibling, idle_cores);
+	}
+#endif
+}
+
 #ifdef CONFIG_SCHED_SMT
 
 static inline void set_idle_cores(int cpu, int val)
@@ -5770,7 +5840,7 @@ static inline bool test_idle_cores(int cpu, bool def)
 
 /*
  * Scans the local SMT mask to see if the entire core is idle, and records this
- * information in sd_llc_shared->has_idle_cores.
+ * information in sd_llc_shared->has_idle_cores and in the LLC idle core mask.
  *
  * Since SMT siblings share all cache levels, inspecting this limited remote
  * state should be fairly cheap.
@@ -5778,10 +5848,11 @@ static inline bool test_idle_cores(int cpu, bool def)
 void __update_idle_core(struct rq *rq)
 {
 	int core = cpu_of(rq);
+	struct cpumask *idle_cores = llc_idle_cores(core);
 	int cpu;
 
 	rcu_read_lock();
-	if (test_idle_cores(core, true))
+	if (cpumask_test_cpu(core, idle_cores))
 		goto unlock;
 
 	for_each_cpu(cpu, cpu_smt_mask(core)) {
@@ -5792,20 +5863,25 @@ void __update_idle_core(struct rq *rq)
 			goto unlock;
 	}
 
-	set_idle_cores(core, 1);
+	for_each_cpu(cpu, cpu_smt_mask(core))
+		cpumask_set_cpu(cpu, idle_cores);
+
+	if (!test_idle_cores(core, true))
+		set_idle_cores(core, 1);
 unlock:
 	rcu_read_unlock();
 }
 
 /*
- * Scan the entire LLC domain for idle cores; this dynamically switches off if
- * there are no idle cores left in the system; tracked through
- * sd_llc->shared->has_idle_cores and enabled through update_idle_core() above.
+ * Look for an idle core among the ones recorded in the LLC idle core mask;
+ * this dynamically switches off if there are no idle cores left in the
+ * system; tracked through sd_llc->shared->has_idle_cores and enabled through
+ * update_idle_core() above.
  */
 static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int target)
 {
 	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
-	int core, cpu, wrap;
+	int core, cpu, wrap, nr = 0;
 
 	if (!static_branch_likely(&sched_smt_present))
 		return -1;
@@ -5814,19 +5890,26 @@ static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int
 		return -1;
 
 	cpumask_and(cpus, sched_domain_span(sd), tsk_cpus_allowed(p));
+	cpumask_and(cpus, cpus, llc_idle_cores(target));
+	schedstat_inc(sd->sis_core_search);
 
 	for_each_cpu_wrap(core, cpus, target, wrap) {
 		bool idle = true;
 
+		nr++;
 		for_each_cpu(cpu, cpu_smt_mask(core)) {
 			cpumask_clear_cpu(cpu, cpus);
 			if (!idle_cpu(cpu))
 				idle = false;
 		}
 
-		if (idle)
+		if (idle) {
+			schedstat_add(sd->sis_scanned, nr);
+			schedstat_inc(sd->sis_core_found);
 			return core;
+		}
 	}
+	schedstat_add(sd->sis_scanned, nr);
 
 	/*
 	 * Failed to find an idle core; stop looking for one.
@@ -5871,17 +5954,20 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
 #endif /* CONFIG_SCHED_SMT */
 
 /*
- * Scan the LLC domain for idle CPUs; this is dynamically regulated by
- * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
- * average idle time for this rq (as found in rq->avg_idle).
+ * Scan the idle CPUs recorded for the LLC domain; this is dynamically
+ * regulated by comparing the average scan cost (tracked in
+ * sd->avg_scan_cost) against the average idle time for this rq (as found in
+ * rq->avg_idle).
  */
 static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
 {
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
 	struct sched_domain *this_sd;
 	u64 avg_cost, avg_idle = this_rq()->avg_idle;
 	u64 time, cost;
 	s64 delta;
-	int cpu, wrap;
+	int cpu, wrap, nr = 0;
+	bool fallback = true;
 
 	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
@@ -5889,6 +5975,13 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 
 	avg_cost = this_sd->avg_scan_cost;
 
+	/*
+	 * Latency nice scales the budget: twice the idle time for the most
+	 * latency sensitive tasks, down to a twentieth for the most tolerant.
+	 */
+	avg_idle = avg_idle * (MAX_LATENCY_NICE + 1 - p->se.latency_nice) /
+		   (MAX_LATENCY_NICE + 1);
+
 	/*
 	 * Due to large variance we need a large fuzz factor; hackbench in
 	 * particularly is sensitive here.
@@ -5898,13 +5991,32 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 
 	time = local_clock();
 
-	for_each_cpu_wrap(cpu, sched_domain_span(sd), target, wrap) {
-		if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
-			continue;
+	cpumask_and(cpus, sched_domain_span(sd), tsk_cpus_allowed(p));
+
+	/*
+	 * An empty mask may just not have caught up with a new sd_llc_id
+	 * yet; scan the whole span then, and put what is found back in.
+	 */
+	if (cpumask_intersects(cpus, llc_idle_cpus(target))) {
+		cpumask_and(cpus, cpus, llc_idle_cpus(target));
+		fallback = false;
+	}
+
+	for_each_cpu_wrap(cpu, cpus, target, wrap) {
+		nr++;
+		/* The mask may lag a cpu that just left idle */
 		if (idle_cpu(cpu))
 			break;
 	}
 
+	if (fallback && cpu < nr_cpumask_bits)
+		cpumask_set_cpu(cpu, llc_idle_cpus(target));
+
+	schedstat_inc(sd->sis_cpu_search);
+	schedstat_add(sd->sis_scanned, nr);
+	if (cpu < nr_cpumask_bits)
+		schedstat_inc(sd->sis_cpu_found);
+
 	time = local_clock() - time;
 	cost = this_sd->avg_scan_cost;
 	delta = (s64)(time - cost) / 8;
@@ -5949,6 +6061,65 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	return target;
 }
 
+#if defined(CONFIG_SCHEDSTATS) && defined(CONFIG_DEBUG_FS)
+/*
+ * The searches count on the LLC domain of the wakeup target.  Every cpu
+ * has its own copy of the domain, and a rebuild of the domains starts
+ * the counts over.
+ */
+static int sched_sis_stat_show(struct seq_file *m, void *v)
+{
+	struct sched_domain *sd;
+	int cpu;
+
+	rcu_read_lock();
+	for_each_online_cpu(cpu) {
+		sd = rcu_dereference(per_cpu(sd_llc, cpu));
+		if (!sd)
+			continue;
+
+		seq_printf(m, "cpu%d core_search %u core_found %u "
+			   "cpu_search %u cpu_found %u scanned %u\n", cpu,
+			   sd->sis_core_search, sd->sis_core_found,
+			   sd->sis_cpu_search, sd->sis_cpu_found,
+			   sd->sis_scanned);
+	}
+	rcu_read_unlock();
+	return 0;
+}
+
+static void sched_sis_stat_reset(void *data)
+{
+	struct sched_domain *sd;
+	int cpu;
+
+	rcu_read_lock();
+	for_each_possible_cpu(cpu) {
+		sd = rcu_dereference(per_cpu(sd_llc, cpu));
+		if (!sd)
+			continue;
+
+		sd->sis_core_search = 0;
+		sd->sis_core_found = 0;
+		sd->sis_cpu_search = 0;
+		sd->sis_cpu_found = 0;
+		sd->sis_scanned = 0;
+	}
+	rcu_read_unlock();
+}
+
+DEFINE_DEBUGFS_STAT(sched_sis_stat);
+
+static int __init sched_sis_stat_debugfs(void)
+{
+	if (!debugfs_create_file("sched_sis", 0600, NULL, NULL,
+				 &sched_sis_stat_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(sched_sis_stat_debugfs);
+#endif
+
 /*
  * cpu_util returns the amount of capacity of a CPU that is used by CFS
  * tasks. The unit of the return value must be the one of capacity so we can
@@ -6200,7 +6371,18 @@ wakeup_gran(struct sched_entity *curr, struct sched_entity *se)
 	 * This is especially important for buddies when the leftmost
 	 * task is higher priority than the buddy.
 	 */
-	return calc_delta_fair(gran, se);
+	gran = calc_delta_fair(gran, se);
+
+	/*
+	 * A 'se' more latency sensitive than 'curr' needs less of a lead to
+	 * preempt it, down to 1/40 of the gran; a more tolerant one needs up
+	 * to twice the gran.
+	 */
+	if (se->latency_nice != curr->latency_nice)
+		gran = gran * (LATENCY_NICE_WIDTH + se->latency_nice -
+			       curr->latency_nice) / LATENCY_NICE_WIDTH;
+
+	return gran;
 }
 
 /*
@@ -9475,6 +9657,7 @@ void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 	}
 
 	se->my_q = cfs_rq;
+	se->latency_nice = tg->latency_nice;
 	/* guarantee group entities always have weight */
 	update_load_set(&se->load, NICE_0_LOAD);
 	se->parent = parent;
@@ -9521,6 +9704,33 @@ done:
 	mutex_unlock(&shares_mutex);
 	return 0;
 }
+
+int sched_group_set_latency(struct task_group *tg, long latency_nice)
+{
+	int i;
+	unsigned long flags;
+
+	/*
+	 * We can't change the latency nice of the root cgroup.
+	 */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	if (latency_nice < MIN_LATENCY_NICE || latency_nice > MAX_LATENCY_NICE)
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+	tg->latency_nice = latency_nice;
+	for_each_possible_cpu(i) {
+		struct rq *rq = cpu_rq(i);
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		tg->se[i]->latency_nice = latency_nice;
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+	mutex_unlock(&shares_mutex);
+	return 0;
+}
 #else /* CONFIG_FAIR_GROUP_SCHED */
 
 void free_fair_sched_group(struct task_group *tg) { }
@@ -225,6 +225,10 @@ static void do_idle(void)
 		check_pgt_cache();
 		rmb();
 
+		/* Catch up with an sd_llc_id change since idle was entered */
+		update_idle_mask(this_rq(), true);
+		update_idle_core(this_rq());
+
 		if (cpu_is_offline(smp_processor_id())) {
 			cpuhp_report_idle_dead();
 			arch_cpu_idle_dead();
@@ -27,6 +27,7 @@ static struct task_struct *
 pick_next_task_idle(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
 {
 	put_prev_task(rq, prev);
+	update_idle_mask(rq, true);
 	update_idle_core(rq);
 	schedstat_inc(rq->sched_goidle);
 /*
@@ -50,6 +51,7 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+	update_idle_mask(rq, false);
 	rq_last_tick_reset(rq);
 }
 
@@ -264,6 +264,11 @@ struct task_group {
     */
 	struct cgroup_subsys_state css;
 
+#ifdef CONFIG_SCHED_SMT
+	/* core scheduling cookie given to the group's tasks, 0 if untagged */
+	unsigned long core_cookie;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* schedulable entities of this group on each cpu */
 /*
@@ -282,6 +287,8 @@ struct task_group {
     用于保存优先级默认为NICE 0的优先级
 */
 	unsigned long shares;
+	/* latency nice of the group entities, see sched_group_set_latency() */
+	int latency_nice;
 
 #ifdef	CONFIG_SMP
 	/*
@@ -392,6 +399,7 @@ extern void sched_move_task(struct task_struct *tsk);
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_latency(struct task_group *tg, long latency_nice);
 
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
@@ -587,6 +595,10 @@ struct dl_rq {
 
 	unsigned long dl_nr_running;
 
+	/* Runtime consumed past the budget by SCHED_FLAG_RECLAIM tasks */
+	u64 reclaimed;
+	unsigned long nr_reclaims;
+
 #ifdef CONFIG_SMP
 	/*
 	 * Deadline values of the currently executing and the
@@ -831,10 +843,34 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* ttwu_queue_remote() stats, counted on the waking cpu */
+	unsigned int ttwu_queued;
+	unsigned int ttwu_ipi;
+	unsigned int ttwu_ipi_coalesced;
 #endif
 
 #ifdef CONFIG_SMP
 	struct llist_head wake_list;
+	/* sched_ttwu_pending() will look at wake_list again before leaving */
+	int wake_list_busy;
+#endif
+
+#ifdef CONFIG_SCHED_SMT
+	/* core scheduling, see sched_core_pick() */
+	raw_spinlock_t core_lock;
+	int core_occupied;		/* runs a task that needs the cookie */
+	unsigned long core_cookie;	/* cookie of that task */
+	int core_prio;			/* and its sched_core_prio() */
+	u64 core_deadline;
+	unsigned long core_wait_cookie;	/* cookie forced idle for */
+	int core_wait_prio;
+	u64 core_wait_deadline;
+	int core_csd_pending;		/* sched_core_preempt() in flight */
+	struct call_single_data core_csd;
+	u64 core_forceidle_start;
+	u64 core_forceidle_sum;		/* ns forced idle with a task to run */
+	unsigned int core_forceidle_count;
 #endif
 
 #ifdef CONFIG_CPU_IDLE
@@ -853,6 +889,12 @@ static inline int cpu_of(struct rq *rq)
 }
 
 
+#ifdef CONFIG_SMP
+extern void update_idle_mask(struct rq *rq, bool idle);
+#else
+static inline void update_idle_mask(struct rq *rq, bool idle) { }
+#endif
+
 #ifdef CONFIG_SCHED_SMT
 
 extern struct static_key_false sched_smt_present;
@@ -1672,6 +1714,10 @@ extern void check_preempt_curr(struct rq *rq, struct task_struct *p, int flags);
 
 extern const_debug unsigned int sysctl_sched_time_avg;
 extern const_debug unsigned int sysctl_sched_nr_migrate;
+extern const_debug unsigned int sysctl_sched_ttwu_coalesce;
+#ifdef CONFIG_SCHED_SMT
+extern const_debug unsigned int sysctl_sched_core_forceidle_max;
+#endif
 extern const_debug unsigned int sysctl_sched_migration_cost;
 
 static inline u64 sched_avg_period(void)
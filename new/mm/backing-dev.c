@@ -25,7 +25,9 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/hash.h>
 #include <trace/events/writeback.h>
+#include "internal.h"
 
 static atomic_long_t bdi_seq = ATOMIC_LONG_INIT(0);
 
@@ -52,6 +54,7 @@ struct workqueue_struct *bdi_wq;
 
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
+#include <linux/debugfs_stat.h>
 #include <linux/seq_file.h>
 
 static struct dentry *bdi_debug_root;
@@ -133,15 +136,92 @@ static const struct file_operations bdi_debug_stats_fops = {
 	.release	= single_release,
 };
 
+static void bdi_debug_hist(struct seq_file *m, const char *name,
+			   atomic_long_t *hist)
+{
+	int b;
+
+	seq_printf(m, "%s:\n", name);
+	for (b = 0; b < BDI_THROTTLE_BUCKETS; b++) {
+		long n = atomic_long_read(&hist[b]);
+
+		if (!n)
+			continue;
+		/* bdi_throttle_hist() puts everything larger in the last one */
+		if (b == BDI_THROTTLE_BUCKETS - 1)
+			seq_printf(m, "  >= %10llu%10s: %ld\n",
+				   1ULL << (b - 1), "", n);
+		else
+			seq_printf(m, "  %10llu - %10llu: %ld\n",
+				   b ? 1ULL << (b - 1) : 0ULL, (1ULL << b) - 1,
+				   n);
+	}
+}
+
+static int bdi_debug_throttle_show(struct seq_file *m, void *v)
+{
+	struct bdi_throttle_stats *ts = m->private;
+
+	seq_printf(m,
+		   "freerun:            %10ld\n"
+		   "short_pause:        %10ld\n"
+		   "clamped_pause:      %10ld\n"
+		   "zero_ratelimit:     %10ld\n"
+		   "memcg_limited:      %10ld\n"
+		   "dirty_exceeded:     %10ld\n",
+		   atomic_long_read(&ts->freerun),
+		   atomic_long_read(&ts->short_pause),
+		   atomic_long_read(&ts->clamped),
+		   atomic_long_read(&ts->zero_ratelimit),
+		   atomic_long_read(&ts->memcg_limited),
+		   atomic_long_read(&ts->dirty_exceeded));
+	bdi_debug_hist(m, "pause_ms", ts->pause_ms);
+	bdi_debug_hist(m, "task_ratelimit_kBps", ts->task_ratelimit);
+	bdi_debug_hist(m, "write_bw_kBps", ts->write_bw);
+	bdi_debug_hist(m, "pos_ratio_1024ths", ts->pos_ratio);
+	return 0;
+}
+
+static void bdi_debug_throttle_reset(void *data)
+{
+	struct bdi_throttle_stats *ts = data;
+	int b;
+
+	for (b = 0; b < BDI_THROTTLE_BUCKETS; b++) {
+		atomic_long_set(&ts->pause_ms[b], 0);
+		atomic_long_set(&ts->task_ratelimit[b], 0);
+		atomic_long_set(&ts->write_bw[b], 0);
+		atomic_long_set(&ts->pos_ratio[b], 0);
+	}
+	atomic_long_set(&ts->freerun, 0);
+	atomic_long_set(&ts->short_pause, 0);
+	atomic_long_set(&ts->clamped, 0);
+	atomic_long_set(&ts->zero_ratelimit, 0);
+	atomic_long_set(&ts->memcg_limited, 0);
+	atomic_long_set(&ts->dirty_exceeded, 0);
+}
+
+DEFINE_DEBUGFS_STAT(bdi_debug_throttle);
+
 static void bdi_debug_register(struct backing_dev_info *bdi, const char *name)
 {
+	struct bdi_throttle_stats *ts = bdi_throttle_stats(bdi);
+
 	bdi->debug_dir = debugfs_create_dir(name, bdi_debug_root);
 	bdi->debug_stats = debugfs_create_file("stats", 0444, bdi->debug_dir,
 					       bdi, &bdi_debug_stats_fops);
+	if (ts)
+		ts->debug_throttle = debugfs_create_file("throttle", 0600,
+						bdi->debug_dir, ts,
+						&bdi_debug_throttle_fops);
 }
 
 static void bdi_debug_unregister(struct backing_dev_info *bdi)
 {
+	struct bdi_throttle_stats *ts = bdi_throttle_stats(bdi);
+
+	if (ts)
+		debugfs_remove(ts->debug_throttle);
 	debugfs_remove(bdi->debug_stats);
 	debugfs_remove(bdi->debug_dir);
 }
@@ -798,6 +878,61 @@ static void cgwb_bdi_destroy(struct backing_dev_info *bdi)
 
 #endif	/* CONFIG_CGROUP_WRITEBACK */
 
+/*
+ * The dirty throttling statistics are kept off struct backing_dev_info,
+ * hashed by the bdi.  The bdi outlives every balance_dirty_pages() on it,
+ * so a looked up entry stays valid for as long as its bdi does.
+ */
+#define BDI_THROTTLE_HASH_BITS	6
+
+static struct hlist_head bdi_throttle_hash[1 << BDI_THROTTLE_HASH_BITS];
+static DEFINE_SPINLOCK(bdi_throttle_lock);
+
+static struct hlist_head *bdi_throttle_head(struct backing_dev_info *bdi)
+{
+	return &bdi_throttle_hash[hash_ptr(bdi, BDI_THROTTLE_HASH_BITS)];
+}
+
+struct bdi_throttle_stats *bdi_throttle_stats(struct backing_dev_info *bdi)
+{
+	struct bdi_throttle_stats *ts;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(ts, bdi_throttle_head(bdi), node)
+		if (ts->bdi == bdi)
+			break;
+	rcu_read_unlock();
+	return ts;
+}
+
+/* Statistics only, throttling works the same without them */
+static void bdi_throttle_stats_add(struct backing_dev_info *bdi)
+{
+	struct bdi_throttle_stats *ts;
+
+	ts = kzalloc(sizeof(*ts), GFP_KERNEL);
+	if (!ts)
+		return;
+	ts->bdi = bdi;
+
+	spin_lock(&bdi_throttle_lock);
+	hlist_add_head_rcu(&ts->node, bdi_throttle_head(bdi));
+	spin_unlock(&bdi_throttle_lock);
+}
+
+static void bdi_throttle_stats_del(struct backing_dev_info *bdi)
+{
+	struct bdi_throttle_stats *ts = bdi_throttle_stats(bdi);
+
+	if (!ts)
+		return;
+
+	spin_lock(&bdi_throttle_lock);
+	hlist_del_rcu(&ts->node);
+	spin_unlock(&bdi_throttle_lock);
+	kfree_rcu(ts, rcu);
+}
+
 int bdi_init(struct backing_dev_info *bdi)
 {
 	int ret;
@@ -814,6 +949,9 @@ int bdi_init(struct backing_dev_info *bdi)
 
 	ret = cgwb_bdi_init(bdi);
 
+	if (!ret)
+		bdi_throttle_stats_add(bdi);
+
 	list_add_tail_rcu(&bdi->wb.bdi_node, &bdi->wb_list);
 
 	return ret;
@@ -920,6 +1058,7 @@ static void bdi_exit(struct backing_dev_info *bdi)
 {
 	WARN_ON_ONCE(bdi->dev);
 	wb_exit(&bdi->wb);
+	bdi_throttle_stats_del(bdi);
 }
 
 static void release_bdi(struct kref *ref)
@@ -43,6 +43,9 @@
 #include <linux/cma.h>
 #include <linux/highmem.h>
 #include <linux/io.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/debugfs_stat.h>
 #include <trace/events/cma.h>
 
 #include "cma.h"
@@ -55,7 +58,6 @@
 */
 struct cma cma_areas[MAX_CMA_AREAS];
 unsigned cma_area_count;
-static DEFINE_MUTEX(cma_mutex);
 
 phys_addr_t cma_get_base(const struct cma *cma)
 {
@@ -95,6 +97,74 @@ static unsigned long cma_bitmap_pages_to_bits(const struct cma *cma,
 	return ALIGN(pages, 1UL << cma->order_per_bit) >> cma->order_per_bit;
 }
 
+/* set or clear bitmap bits and keep the free summary in sync */
+static void cma_bitmap_update(struct cma *cma, unsigned long bitmap_no,
+			      unsigned long bitmap_count, bool set)
+{
+	unsigned long end = bitmap_no + bitmap_count;
+
+	lockdep_assert_held(&cma->lock);
+
+	if (set) {
+		bitmap_set(cma->bitmap, bitmap_no, bitmap_count);
+		cma->free_bits -= bitmap_count;
+	} else {
+		bitmap_clear(cma->bitmap, bitmap_no, bitmap_count);
+		cma->free_bits += bitmap_count;
+	}
+
+	while (bitmap_no < end) {
+		unsigned long chunk = bitmap_no / CMA_SUMMARY_BITS;
+		unsigned long nr = min(end, (chunk + 1) * CMA_SUMMARY_BITS) -
+				   bitmap_no;
+
+		if (set)
+			cma->free_count[chunk] -= nr;
+		else
+			cma->free_count[chunk] += nr;
+		bitmap_no += nr;
+	}
+}
+
+/*
+ * Same result as bitmap_find_next_zero_area_off() on cma->bitmap, but
+ * summary chunks without a free bit are skipped without looking at the
+ * bitmap, and requests larger than the free total fail immediately.
+ */
+static unsigned long cma_find_free_area(struct cma *cma, unsigned long start,
+					unsigned long bitmap_count,
+					unsigned long mask,
+					unsigned long offset)
+{
+	unsigned long maxno = cma_bitmap_maxno(cma);
+	unsigned long nr_chunks = DIV_ROUND_UP(maxno, CMA_SUMMARY_BITS);
+	unsigned long chunk, index, end, i;
+
+	lockdep_assert_held(&cma->lock);
+
+	if (bitmap_count > cma->free_bits)
+		return maxno;
+
+	for (;;) {
+		chunk = start / CMA_SUMMARY_BITS;
+		while (chunk < nr_chunks && !cma->free_count[chunk])
+			chunk++;
+		if (chunk >= nr_chunks)
+			return maxno;
+		start = max(start, chunk * CMA_SUMMARY_BITS);
+
+		index = find_next_zero_bit(cma->bitmap, maxno, start);
+		index = __ALIGN_MASK(index + offset, mask) - offset;
+		end = index + bitmap_count;
+		if (end > maxno)
+			return maxno;
+		i = find_next_bit(cma->bitmap, end, index);
+		if (i >= end)
+			return index;
+		start = i + 1;
+	}
+}
+
 static void cma_clear_bitmap(struct cma *cma, unsigned long pfn,
 			     unsigned int count)
 {
@@ -104,10 +174,137 @@ static void cma_clear_bitmap(struct cma *cma, unsigned long pfn,
 	bitmap_count = cma_bitmap_pages_to_bits(cma, count);
 
 	mutex_lock(&cma->lock);
-	bitmap_clear(cma->bitmap, bitmap_no, bitmap_count);
+	cma_bitmap_update(cma, bitmap_no, bitmap_count, false);
 	mutex_unlock(&cma->lock);
 }
 
+/*
+ * alloc_contig_range() isolates whole blocks of this order around the
+ * requested range, so two allocations may only run it concurrently if
+ * they do not share such a block.  CMA areas are aligned to it.
+ */
+static unsigned int cma_isolate_order(void)
+{
+	return max_t(unsigned long, MAX_ORDER - 1, pageblock_order);
+}
+
+static unsigned long cma_isolate_blocks(struct cma *cma)
+{
+	return DIV_ROUND_UP(cma->count, 1UL << cma_isolate_order());
+}
+
+static bool cma_try_lock_range(struct cma *cma, unsigned long pfn,
+			       unsigned long count)
+{
+	unsigned long first = (pfn - cma->base_pfn) >> cma_isolate_order();
+	unsigned long last = (pfn + count - 1 - cma->base_pfn) >>
+			     cma_isolate_order();
+	bool locked = false;
+
+	spin_lock(&cma->busy_lock);
+	if (find_next_bit(cma->busy_map, last + 1, first) > last) {
+		bitmap_set(cma->busy_map, first, last - first + 1);
+		locked = true;
+	}
+	spin_unlock(&cma->busy_lock);
+
+	return locked;
+}
+
+static void cma_unlock_range(struct cma *cma, unsigned long pfn,
+			     unsigned long count)
+{
+	unsigned long first = (pfn - cma->base_pfn) >> cma_isolate_order();
+	unsigned long last = (pfn + count - 1 - cma->base_pfn) >>
+			     cma_isolate_order();
+
+	spin_lock(&cma->busy_lock);
+	bitmap_clear(cma->busy_map, first, last - first + 1);
+	spin_unlock(&cma->busy_lock);
+	wake_up_all(&cma->busy_wait);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void cma_account_alloc(struct cma *cma, ktime_t start, bool failed)
+{
+	u64 us = ktime_us_delta(ktime_get(), start);
+
+	atomic_long_inc(&cma->alloc_latency[min_t(unsigned int, fls64(us),
+					CMA_LATENCY_BUCKETS - 1)]);
+	if (failed)
+		atomic_long_inc(&cma->alloc_failures);
+}
+
+static void cma_account_retry(struct cma *cma)
+{
+	atomic_long_inc(&cma->alloc_retries);
+}
+
+static int cma_latency_show(struct seq_file *m, void *v)
+{
+	int i, b;
+
+	for (i = 0; i < cma_area_count; i++) {
+		struct cma *cma = &cma_areas[i];
+
+		seq_printf(m, "cma%d: base_pfn %lu count %lu free %lu retries %ld failures %ld\n",
+			   i, cma->base_pfn, cma->count,
+			   cma->free_bits << cma->order_per_bit,
+			   atomic_long_read(&cma->alloc_retries),
+			   atomic_long_read(&cma->alloc_failures));
+		for (b = 0; b < CMA_LATENCY_BUCKETS; b++) {
+			long n = atomic_long_read(&cma->alloc_latency[b]);
+
+			if (!n)
+				continue;
+			/* the last bucket takes everything above */
+			if (b == CMA_LATENCY_BUCKETS - 1)
+				seq_printf(m, "  >= %10llu%10s us: %ld\n",
+					   1ULL << (b - 1), "", n);
+			else
+				seq_printf(m, "  %10llu - %10llu us: %ld\n",
+					   b ? 1ULL << (b - 1) : 0ULL,
+					   (1ULL << b) - 1, n);
+		}
+	}
+	return 0;
+}
+
+static void cma_latency_reset(void *data)
+{
+	int i, b;
+
+	for (i = 0; i < cma_area_count; i++) {
+		struct cma *cma = &cma_areas[i];
+
+		for (b = 0; b < CMA_LATENCY_BUCKETS; b++)
+			atomic_long_set(&cma->alloc_latency[b], 0);
+		atomic_long_set(&cma->alloc_retries, 0);
+		atomic_long_set(&cma->alloc_failures, 0);
+	}
+}
+
+DEFINE_DEBUGFS_STAT(cma_latency);
+
+static int __init cma_latency_debugfs(void)
+{
+	if (!debugfs_create_file("cma_alloc_latency", 0600, NULL, NULL,
+				 &cma_latency_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(cma_latency_debugfs);
+#else
+static inline void cma_account_alloc(struct cma *cma, ktime_t start,
+				     bool failed)
+{
+}
+
+static inline void cma_account_retry(struct cma *cma)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
 static int __init cma_activate_area(struct cma *cma)
 {
 /*
@@ -120,6 +317,8 @@ static int __init cma_activate_area(struct cma *cma)
     该CMA area有多少个pageblock
 */
 	unsigned i = cma->count >> pageblock_order;
+	unsigned long maxno = cma_bitmap_maxno(cma);
+	unsigned long chunk;
 	struct zone *zone;
 
 	cma->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
@@ -127,6 +326,18 @@ static int __init cma_activate_area(struct cma *cma)
 	if (!cma->bitmap)
 		return -ENOMEM;
 
+	cma->free_count = kcalloc(DIV_ROUND_UP(maxno, CMA_SUMMARY_BITS),
+				  sizeof(cma->free_count[0]), GFP_KERNEL);
+	cma->busy_map = kcalloc(BITS_TO_LONGS(cma_isolate_blocks(cma)),
+				sizeof(long), GFP_KERNEL);
+	if (!cma->free_count || !cma->busy_map)
+		goto err;
+
+	cma->free_bits = maxno;
+	for (chunk = 0; chunk * CMA_SUMMARY_BITS < maxno; chunk++)
+		cma->free_count[chunk] = min_t(unsigned long, CMA_SUMMARY_BITS,
+					       maxno - chunk * CMA_SUMMARY_BITS);
+
 	WARN_ON_ONCE(!pfn_valid(pfn));
 	zone = page_zone(pfn_to_page(pfn));
 
@@ -159,6 +370,8 @@ static int __init cma_activate_area(struct cma *cma)
 	} while (--i);
 
 	mutex_init(&cma->lock);
+	spin_lock_init(&cma->busy_lock);
+	init_waitqueue_head(&cma->busy_wait);
 
 #ifdef CONFIG_CMA_DEBUGFS
 	INIT_HLIST_HEAD(&cma->mem_head);
@@ -168,6 +381,8 @@ static int __init cma_activate_area(struct cma *cma)
 	return 0;
 
 err:
+	kfree(cma->busy_map);
+	kfree(cma->free_count);
 	kfree(cma->bitmap);
 	cma->count = 0;
 	return -EINVAL;
@@ -386,7 +601,8 @@ err:
  * @align: Requested alignment of pages (in PAGE_SIZE order).
  *
  * This function allocates part of contiguous memory on specific
- * contiguous memory area.
+ * contiguous memory area.  Allocations whose ranges do not share an
+ * isolation block migrate their pages concurrently.
  */
 struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 {
@@ -395,6 +611,7 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 	unsigned long start = 0;
 	unsigned long bitmap_maxno, bitmap_no, bitmap_count;
 	struct page *page = NULL;
+	ktime_t start_time;
 	int ret;
 
 	if (!cma || !cma->count)
@@ -414,16 +631,16 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 	if (bitmap_count > bitmap_maxno)
 		return NULL;
 
+	start_time = ktime_get();
 	for (;;) {
 		mutex_lock(&cma->lock);
-		bitmap_no = bitmap_find_next_zero_area_off(cma->bitmap,
-				bitmap_maxno, start, bitmap_count, mask,
-				offset);
+		bitmap_no = cma_find_free_area(cma, start, bitmap_count, mask,
+					       offset);
 		if (bitmap_no >= bitmap_maxno) {
 			mutex_unlock(&cma->lock);
 			break;
 		}
-		bitmap_set(cma->bitmap, bitmap_no, bitmap_count);
+		cma_bitmap_update(cma, bitmap_no, bitmap_count, true);
 		/*
 		 * It's safe to drop the lock here. We've marked this region for
 		 * our exclusive use. If the migration fails we will take the
@@ -432,9 +649,9 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 		mutex_unlock(&cma->lock);
 
 		pfn = cma->base_pfn + (bitmap_no << cma->order_per_bit);
-		mutex_lock(&cma_mutex);
+		wait_event(cma->busy_wait, cma_try_lock_range(cma, pfn, count));
 		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
-		mutex_unlock(&cma_mutex);
+		cma_unlock_range(cma, pfn, count);
 		if (ret == 0) {
 			page = pfn_to_page(pfn);
 			break;
@@ -446,10 +663,12 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 
 		pr_debug("%s(): memory range at %p is busy, retrying\n",
 			 __func__, pfn_to_page(pfn));
+		cma_account_retry(cma);
 		/* try again with a bit different memory target */
 		start = bitmap_no + mask + 1;
 	}
 
+	cma_account_alloc(cma, start_time, !page);
 	trace_cma_alloc(pfn, page, count, align);
 
 	pr_debug("%s(): returned %p\n", __func__, page);
@@ -1,6 +1,11 @@
 #ifndef __MM_CMA_H__
 #define __MM_CMA_H__
 
+/* bitmap bits summarised by one cma->free_count entry */
+#define CMA_SUMMARY_BITS	1024
+/* cma_alloc() latency histogram, in log2 microseconds */
+#define CMA_LATENCY_BUCKETS	24
+
 struct cma {
 /*
     CMA area的其实page frame number，base_pfn和count一起定义了该CMA area在内存在的位置
@@ -20,7 +25,27 @@ struct cma {
 	如果order_per_bit等于1，表示按照2个page组成的block来分配和释放，以此类推
 */
 	unsigned int order_per_bit; /* Order of pages represented by one bit */
+	/*
+	 * Summary of the bitmap: the number of clear bits in each
+	 * CMA_SUMMARY_BITS chunk, so that searches skip full chunks, and in
+	 * the whole bitmap, so that hopeless requests fail at once.
+	 */
+	unsigned short	*free_count;
+	unsigned long	free_bits;
 	struct mutex    lock;
+	/*
+	 * Isolation blocks (the unit alloc_contig_range() isolates pages in)
+	 * with an allocation in flight, protected by busy_lock.  Allocations
+	 * only wait for each other when their ranges share such a block.
+	 */
+	unsigned long	*busy_map;
+	spinlock_t	busy_lock;
+	wait_queue_head_t busy_wait;
+#ifdef CONFIG_DEBUG_FS
+	atomic_long_t	alloc_latency[CMA_LATENCY_BUCKETS];
+	atomic_long_t	alloc_retries;
+	atomic_long_t	alloc_failures;
+#endif
 #ifdef CONFIG_CMA_DEBUGFS
 	struct hlist_head mem_head;
 	spinlock_t mem_head_lock;
@@ -23,6 +23,8 @@
 #include <linux/kthread.h>
 #include <linux/freezer.h>
 #include <linux/page_owner.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "internal.h"
 
 #ifdef CONFIG_COMPACTION
@@ -1278,6 +1280,122 @@ static inline bool is_via_compact_memory(int order)
 	return order == -1;
 }
 
+/*
+ * Fragmentation score check interval for proactive compaction purposes.
+ */
+#define HPAGE_FRAG_CHECK_INTERVAL_MSEC	(500)
+
+/*
+ * Page order with-respect-to which proactive compaction
+ * calculates external fragmentation, which is used as
+ * the "fragmentation score" of a node/zone.
+ */
+#if defined CONFIG_TRANSPARENT_HUGEPAGE
+#define COMPACTION_HPAGE_ORDER	HPAGE_PMD_ORDER
+#elif defined CONFIG_HUGETLBFS
+#define COMPACTION_HPAGE_ORDER	HUGETLB_PAGE_ORDER
+#else
+#define COMPACTION_HPAGE_ORDER	(PMD_SHIFT - PAGE_SHIFT)
+#endif
+
+/*
+ * A zero value disables proactive compaction; higher values make kcompactd
+ * keep the fragmentation score of each node lower.
+ */
+static int sysctl_compaction_proactiveness = 20;
+
+static inline bool kswapd_is_running(pg_data_t *pgdat)
+{
+	return pgdat->kswapd && (pgdat->kswapd->state == TASK_RUNNING);
+}
+
+/*
+ * Percentage of free memory in the zone that is not available for an
+ * allocation of the given order, i.e. that lives in smaller free blocks.
+ * The free lists are read locklessly, the result is only a heuristic.
+ */
+static unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	unsigned long free_pages = 0, suitable_pages = 0;
+	unsigned int o;
+
+	for (o = 0; o < MAX_ORDER; o++) {
+		unsigned long blocks = zone->free_area[o].nr_free;
+
+		free_pages += blocks << o;
+		if (o >= order)
+			suitable_pages += blocks << o;
+	}
+
+	if (!free_pages)
+		return 0;
+
+	return div64_u64((u64)(free_pages - suitable_pages) * 100, free_pages);
+}
+
+/*
+ * The fragmentation score of a zone is its external fragmentation for
+ * COMPACTION_HPAGE_ORDER, in the range [0, 100].
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	return extfrag_for_order(zone, COMPACTION_HPAGE_ORDER);
+}
+
+/*
+ * The zone score scaled by the share of the node's memory that the zone
+ * holds, so that small zones do not dominate the node score.
+ */
+static unsigned int fragmentation_score_zone_weighted(struct zone *zone)
+{
+	unsigned long score;
+
+	score = zone->present_pages * fragmentation_score_zone(zone);
+	return div64_ul(score, zone->zone_pgdat->node_present_pages + 1);
+}
+
+/*
+ * The per-node fragmentation score is the sum of its zone scores, in the
+ * range [0, 100].  Proactive compaction tries to bring it below the low
+ * watermark and starts once it exceeds the high watermark.
+ */
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned int score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		score += fragmentation_score_zone_weighted(zone);
+	}
+
+	return score;
+}
+
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	/*
+	 * Cap the low watermark to avoid excessive compaction
+	 * activity in case a user sets the proactiveness tunable
+	 * close to 100 (maximum).
+	 */
+	wmark_low = max(100U - sysctl_compaction_proactiveness, 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness || kswapd_is_running(pgdat))
+		return false;
+
+	return fragmentation_score_node(pgdat) > fragmentation_score_wmark(false);
+}
+
 static enum compact_result __compact_finished(struct zone *zone, struct compact_control *cc,
 			    const int migratetype)
 {
@@ -1307,6 +1425,21 @@ static enum compact_result __compact_finished(struct zone *zone, struct compact_
 			return COMPACT_PARTIAL_SKIPPED;
 	}
 
+	/*
+	 * Proactive compaction stops as soon as the zone is below the low
+	 * watermark, or backs off if reclaim started running on the node.
+	 * Only look once per pageblock, the score is not free to compute.
+	 */
+	if (cc->proactive_compaction &&
+	    IS_ALIGNED(cc->migrate_pfn, pageblock_nr_pages)) {
+		if (kswapd_is_running(zone->zone_pgdat))
+			return COMPACT_PARTIAL_SKIPPED;
+
+		if (fragmentation_score_zone(zone) <=
+					fragmentation_score_wmark(true))
+			return COMPACT_SUCCESS;
+	}
+
 	if (is_via_compact_memory(cc->order))
 		return COMPACT_CONTINUE;
 
@@ -1793,6 +1926,57 @@ static void compact_node(int nid)
 	}
 }
 
+/*
+ * Compact the zones of a node in the background until its fragmentation
+ * score falls below the low watermark.  Like compact_node(), but uses
+ * sync light migration and gives up early when asked to stop.
+ */
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = -1,
+		.mode = MIGRATE_SYNC_LIGHT,
+		.ignore_skip_hint = true,
+		.whole_zone = true,
+		.gfp_mask = GFP_KERNEL,
+		.proactive_compaction = true,
+	};
+
+	pgdat->proactive_compact_runs++;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		if (kthread_should_stop())
+			return;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.total_migrate_scanned = 0;
+		cc.total_free_scanned = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		pgdat->proactive_compact_migrate_scanned +=
+						cc.total_migrate_scanned;
+		pgdat->proactive_compact_free_scanned += cc.total_free_scanned;
+		count_compact_events(KCOMPACTD_MIGRATE_SCANNED,
+				     cc.total_migrate_scanned);
+		count_compact_events(KCOMPACTD_FREE_SCANNED,
+				     cc.total_free_scanned);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
 /* Compact all nodes in the system */
 static void compact_nodes(void)
 {
@@ -1829,6 +2013,22 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+static int compaction_proactiveness_min;
+static int compaction_proactiveness_max = 100;
+
+static struct ctl_table compaction_sysctl_table[] = {
+	{
+		.procname	= "compaction_proactiveness",
+		.data		= &sysctl_compaction_proactiveness,
+		.maxlen		= sizeof(sysctl_compaction_proactiveness),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &compaction_proactiveness_min,
+		.extra2		= &compaction_proactiveness_max,
+	},
+	{ }
+};
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 static ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
@@ -1998,6 +2198,8 @@ static int kcompactd(void *p)
 {
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
+	unsigned int proactive_defer = 0;
+	long timeout = msecs_to_jiffies(HPAGE_FRAG_CHECK_INTERVAL_MSEC);
 
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
 
@@ -2010,11 +2212,35 @@ static int kcompactd(void *p)
 	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
 
 	while (!kthread_should_stop()) {
+		unsigned int prev_score, score;
+
 		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
-		wait_event_freezable(pgdat->kcompactd_wait,
-				kcompactd_work_requested(pgdat));
+		if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout)) {
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		/* kcompactd wait timeout: look at the fragmentation score */
+		if (!should_proactive_compact_node(pgdat))
+			continue;
+
+		if (proactive_defer) {
+			proactive_defer--;
+			continue;
+		}
 
-		kcompactd_do_work(pgdat);
+		prev_score = fragmentation_score_node(pgdat);
+		proactive_compact_node(pgdat);
+		score = fragmentation_score_node(pgdat);
+		/*
+		 * Defer proactive compaction if the fragmentation score did
+		 * not go down, i.e. no progress was made.
+		 */
+		if (score >= prev_score) {
+			proactive_defer = 1 << COMPACT_MAX_DEFER_SHIFT;
+			pgdat->proactive_compact_deferred++;
+		}
 	}
 
 	return 0;
@@ -2078,6 +2304,57 @@ static int kcompactd_cpu_online(unsigned int cpu)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int proactive_compaction_show(struct seq_file *m, void *arg)
+{
+	int nid;
+
+	seq_printf(m, "proactiveness %d wmark_low %u wmark_high %u\n",
+		   sysctl_compaction_proactiveness,
+		   fragmentation_score_wmark(true),
+		   fragmentation_score_wmark(false));
+
+	for_each_node_state(nid, N_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		seq_printf(m, "node %d score %u runs %lu deferred %lu "
+			   "migrate_scanned %lu free_scanned %lu\n",
+			   nid, fragmentation_score_node(pgdat),
+			   pgdat->proactive_compact_runs,
+			   pgdat->proactive_compact_deferred,
+			   pgdat->proactive_compact_migrate_scanned,
+			   pgdat->proactive_compact_free_scanned);
+	}
+
+	return 0;
+}
+
+static int proactive_compaction_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proactive_compaction_show, NULL);
+}
+
+static const struct file_operations proactive_compaction_fops = {
+	.open		= proactive_compaction_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init proactive_compaction_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("compaction", NULL);
+	if (!dir)
+		return;
+	debugfs_create_file("proactive", S_IRUGO, dir, NULL,
+			    &proactive_compaction_fops);
+}
+#else
+static inline void proactive_compaction_debugfs_init(void) { }
+#endif
+
 static int __init kcompactd_init(void)
 {
 	int nid;
@@ -2093,6 +2370,10 @@ static int __init kcompactd_init(void)
 
 	for_each_node_state(nid, N_MEMORY)
 		kcompactd_run(nid);
+
+	if (!register_sysctl("vm", compaction_sysctl_table))
+		pr_warn("kcompactd: failed to register sysctl table.\n");
+	proactive_compaction_debugfs_init();
 	return 0;
 }
 subsys_initcall(kcompactd_init)
@@ -15,9 +15,11 @@
  * Many older drivers still have their own code to do this.
  *
  * The current design of this allocator is fairly simple.  The pool is
- * represented by the 'struct dma_pool' which keeps a doubly-linked list of
- * allocated pages.  Each page in the page_list is split into blocks of at
- * least 'size' bytes.  Free blocks are tracked in an unsorted singly-linked
+ * represented by the 'struct dma_pool' which keeps its allocated pages on
+ * two doubly-linked lists, one for pages with free blocks and one for full
+ * pages, and in an rbtree ordered by dma address for finding the page a
+ * freed block belongs to.  Each page is split into blocks of at least
+ * 'size' bytes.  Free blocks are tracked in an unsorted singly-linked
  * list of free blocks within the page.  Used blocks aren't tracked, but we
  * keep a count of how many are currently allocated from each page.
  */
@@ -30,6 +32,7 @@
 #include <linux/export.h>
 #include <linux/mutex.h>
 #include <linux/poison.h>
+#include <linux/rbtree.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/stat.h>
@@ -50,7 +53,12 @@
  */
 
 struct dma_pool {		/* the pool */
-	struct list_head page_list;
+	struct list_head avail_list;	/* pages with free blocks */
+	struct list_head full_list;	/* pages without */
+	struct rb_root page_tree;	/* all pages, by dma address */
+	unsigned int nr_pages;
+	unsigned int nr_full;
+	unsigned long nr_active;	/* blocks in use */
 	spinlock_t lock;
 	size_t size;
 	struct device *dev;
@@ -61,7 +69,8 @@ struct dma_pool {		/* the pool */
 };
 
 struct dma_page {		/* cacheable header for 'allocation' bytes */
-	struct list_head page_list;
+	struct list_head page_list;	/* on avail_list or full_list */
+	struct rb_node node;		/* in page_tree */
 	void *vaddr;
 	dma_addr_t dma;
 	unsigned int in_use;
@@ -77,7 +86,6 @@ show_pools(struct device *dev, struct device_attribute *attr, char *buf)
 	unsigned temp;
 	unsigned size;
 	char *next;
-	struct dma_page *page;
 	struct dma_pool *pool;
 
 	next = buf;
@@ -89,21 +97,23 @@ show_pools(struct device *dev, struct device_attribute *attr, char *buf)
 
 	mutex_lock(&pools_lock);
 	list_for_each_entry(pool, &dev->dma_pools, pools) {
-		unsigned pages = 0;
-		unsigned blocks = 0;
+		unsigned pages, full;
+		unsigned long blocks;
 
 		spin_lock_irq(&pool->lock);
-		list_for_each_entry(page, &pool->page_list, page_list) {
-			pages++;
-			blocks += page->in_use;
-		}
+		pages = pool->nr_pages;
+		full = pool->nr_full;
+		blocks = pool->nr_active;
 		spin_unlock_irq(&pool->lock);
 
-		/* per-pool info, no real statistics yet */
-		temp = scnprintf(next, size, "%-16s %4u %4Zu %4Zu %2u\n",
+		/*
+		 * name, blocks in use, total blocks, block size, pages,
+		 * and full pages
+		 */
+		temp = scnprintf(next, size, "%-16s %4lu %4Zu %4Zu %2u %2u\n",
 				 pool->name, blocks,
 				 pages * (pool->allocation / pool->size),
-				 pool->size, pages);
+				 pool->size, pages, full);
 		size -= temp;
 		next += temp;
 	}
@@ -187,7 +197,12 @@ struct dma_pool *dma_pool_create(const char *name, struct device *dev,
 	retval->dev = dev;
 
 	/* 初始化dma_pool结构对象retval */
-	INIT_LIST_HEAD(&retval->page_list);
+	INIT_LIST_HEAD(&retval->avail_list);
+	INIT_LIST_HEAD(&retval->full_list);
+	retval->page_tree = RB_ROOT;
+	retval->nr_pages = 0;
+	retval->nr_full = 0;
+	retval->nr_active = 0;
 	spin_lock_init(&retval->lock);
 	retval->size = size;
 	retval->boundary = boundary;
@@ -271,6 +286,41 @@ static inline bool is_page_busy(struct dma_page *page)
 	return page->in_use != 0;
 }
 
+static inline bool is_page_full(struct dma_pool *pool, struct dma_page *page)
+{
+	return page->offset >= pool->allocation;
+}
+
+/* pages never overlap, so ordering by start address is enough */
+static void pool_insert_page(struct dma_pool *pool, struct dma_page *page)
+{
+	struct rb_node **p = &pool->page_tree.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct dma_page *tmp = rb_entry(*p, struct dma_page, node);
+
+		parent = *p;
+		if (page->dma < tmp->dma)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&page->node, parent, p);
+	rb_insert_color(&page->node, &pool->page_tree);
+	pool->nr_pages++;
+}
+
+/* unlink a page from the pool, the caller frees it */
+static void pool_remove_page(struct dma_pool *pool, struct dma_page *page)
+{
+	if (is_page_full(pool, page))
+		pool->nr_full--;
+	list_del(&page->page_list);
+	rb_erase(&page->node, &pool->page_tree);
+	pool->nr_pages--;
+}
+
 static void pool_free_page(struct dma_pool *pool, struct dma_page *page)
 {
 	dma_addr_t dma = page->dma;
@@ -279,7 +329,7 @@ static void pool_free_page(struct dma_pool *pool, struct dma_page *page)
 	memset(page->vaddr, POOL_POISON_FREED, pool->allocation);
 #endif
 	dma_free_coherent(pool->dev, pool->allocation, page->vaddr, dma);
-	list_del(&page->page_list);
+	pool_remove_page(pool, page);
 	kfree(page);
 }
 
@@ -311,10 +361,16 @@ void dma_pool_destroy(struct dma_pool *pool)
 		device_remove_file(pool->dev, &dev_attr_pools);
 	mutex_unlock(&pools_reg_lock);
 
-	while (!list_empty(&pool->page_list)) {
+	while (!list_empty(&pool->avail_list) ||
+	       !list_empty(&pool->full_list)) {
 		struct dma_page *page;
-		page = list_entry(pool->page_list.next,
-				  struct dma_page, page_list);
+
+		if (!list_empty(&pool->avail_list))
+			page = list_first_entry(&pool->avail_list,
+						struct dma_page, page_list);
+		else
+			page = list_first_entry(&pool->full_list,
+						struct dma_page, page_list);
 		if (is_page_busy(page)) {
 			if (pool->dev)
 				dev_err(pool->dev,
@@ -324,7 +380,7 @@ void dma_pool_destroy(struct dma_pool *pool)
 				pr_err("dma_pool_destroy %s, %p busy\n",
 				       pool->name, page->vaddr);
 			/* leak the still-in-use consistent memory */
-			list_del(&page->page_list);
+			pool_remove_page(pool, page);
 			kfree(page);
 		} else
 			pool_free_page(pool, page);
@@ -365,10 +421,11 @@ void *dma_pool_alloc(struct dma_pool *pool, gfp_t mem_flags,
 	might_sleep_if(gfpflags_allow_blocking(mem_flags));
 
 	spin_lock_irqsave(&pool->lock, flags);
-	list_for_each_entry(page, &pool->page_list, page_list) {
-		if (page->offset < pool->allocation)
-			goto ready;
-	}
+	/* full pages live on their own list, any page here has a free block */
+	page = list_first_entry_or_null(&pool->avail_list, struct dma_page,
+					page_list);
+	if (page)
+		goto ready;
 
 	/* pool_alloc_page() might sleep, so temporarily drop &pool->lock */
 	spin_unlock_irqrestore(&pool->lock, flags);
@@ -379,11 +436,17 @@ void *dma_pool_alloc(struct dma_pool *pool, gfp_t mem_flags,
 
 	spin_lock_irqsave(&pool->lock, flags);
 
-	list_add(&page->page_list, &pool->page_list);
+	list_add(&page->page_list, &pool->avail_list);
+	pool_insert_page(pool, page);
  ready:
 	page->in_use++;
+	pool->nr_active++;
 	offset = page->offset;
 	page->offset = *(int *)(page->vaddr + offset);
+	if (is_page_full(pool, page)) {
+		list_move(&page->page_list, &pool->full_list);
+		pool->nr_full++;
+	}
 	/* 返回虚拟地址 */
 	retval = offset + page->vaddr;
 	/* 相对DMA地址 */
@@ -427,12 +490,16 @@ EXPORT_SYMBOL(dma_pool_alloc);
 
 static struct dma_page *pool_find_page(struct dma_pool *pool, dma_addr_t dma)
 {
-	struct dma_page *page;
+	struct rb_node *n = pool->page_tree.rb_node;
+
+	while (n) {
+		struct dma_page *page = rb_entry(n, struct dma_page, node);
 
-	list_for_each_entry(page, &pool->page_list, page_list) {
 		if (dma < page->dma)
-			continue;
-		if ((dma - page->dma) < pool->allocation)
+			n = n->rb_left;
+		else if ((dma - page->dma) >= pool->allocation)
+			n = n->rb_right;
+		else
 			return page;
 	}
 	return NULL;
@@ -503,7 +570,13 @@ void dma_pool_free(struct dma_pool *pool, void *vaddr, dma_addr_t dma)
 	memset(vaddr, POOL_POISON_FREED, pool->size);
 #endif
 
+	/* the page gets a free block back, make it available again */
+	if (is_page_full(pool, page)) {
+		list_move(&page->page_list, &pool->avail_list);
+		pool->nr_full--;
+	}
 	page->in_use--;
+	pool->nr_active--;
 	*(int *)vaddr = page->offset;
 	page->offset = offset;
 	/*
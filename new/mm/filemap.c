@@ -1797,6 +1797,56 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Reads spanning several pages look up to PAGEVEC_SIZE contiguous cached
+ * pages in one radix tree walk and consume them in order.  The batch is
+ * dropped as soon as it stops matching the read position or reaches a page
+ * that is not uptodate, and that page then takes the regular slow path.
+ */
+struct read_batch {
+	unsigned int idx;
+	unsigned int nr;
+	struct page *pages[PAGEVEC_SIZE];
+};
+
+static void read_batch_drop(struct read_batch *rb)
+{
+	while (rb->idx < rb->nr)
+		put_page(rb->pages[rb->idx++]);
+}
+
+static struct page *read_batch_get(struct address_space *mapping,
+				   struct read_batch *rb,
+				   pgoff_t index, pgoff_t last_index)
+{
+	struct page *page;
+
+	if (rb->idx == rb->nr) {
+		if (last_index - index < 2)
+			return NULL;
+		rb->idx = 0;
+		rb->nr = find_get_pages_contig(mapping, index,
+				min_t(pgoff_t, last_index - index, PAGEVEC_SIZE),
+				rb->pages);
+		if (!rb->nr)
+			return NULL;
+	}
+
+	page = rb->pages[rb->idx++];
+	/*
+	 * Copying the earlier pages of the batch may have faulted and
+	 * slept, so this one may have been truncated since the lookup.
+	 */
+	if (page->mapping != mapping || page_to_pgoff(page) != index) {
+		put_page(page);
+		read_batch_drop(rb);
+		return NULL;
+	}
+	if (!PageUptodate(page))
+		read_batch_drop(rb);
+	return page;
+}
+
 /**
  * do_generic_file_read - generic file read routine
  * @filp:	the file to read
@@ -1828,8 +1878,11 @@ static ssize_t do_generic_file_read(struct file *filp, loff_t *ppos,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	struct read_batch batch;
 	int error = 0;
 
+	batch.idx = batch.nr = 0;
+
 	if (unlikely(*ppos >= inode->i_sb->s_maxbytes))
 		return 0;
 	iov_iter_truncate(iter, inode->i_sb->s_maxbytes);
@@ -1862,8 +1915,10 @@ find_page:
 			error = -EINTR;
 			goto out;
 		}
-		/* 检查页是否在缓存中 */
-		page = find_get_page(mapping, index);
+		/* 检查页是否在缓存中，先尝试批量查找到的连续页面 */
+		page = read_batch_get(mapping, &batch, index, last_index);
+		if (!page)
+			page = find_get_page(mapping, index);
 		/* 页不在缓存中 */
 		if (!page) {
 			/* 同步预读 */
@@ -2088,6 +2143,7 @@ no_cached_page:
 	}
 
 out:
+	read_batch_drop(&batch);
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_SHIFT;
 	ra->prev_pos |= prev_offset;
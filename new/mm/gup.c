@@ -13,6 +13,8 @@
 #include <linux/sched.h>
 #include <linux/rwsem.h>
 #include <linux/hugetlb.h>
+#include <linux/percpu.h>
+#include <linux/debugfs_stat.h>
 
 #include <asm/mmu_context.h>
 #include <asm/pgtable.h>
@@ -1319,6 +1321,18 @@ static int gup_pte_range(pmd_t pmd, unsigned long addr, unsigned long end,
 }
 #endif /* __HAVE_ARCH_PTE_SPECIAL */
 
+/*
+ * Drop the @refs references a huge mapping took on its head page in one
+ * go.  The caller still holds its own reference through the last one, so
+ * only that can be the final put.
+ */
+static void gup_put_huge_refs(struct page *head, int refs)
+{
+	VM_BUG_ON_PAGE(page_ref_count(head) < refs, head);
+	page_ref_sub(head, refs - 1);
+	put_page(head);
+}
+
 static int gup_huge_pmd(pmd_t orig, pmd_t *pmdp, unsigned long addr,
 		unsigned long end, int write, struct page **pages, int *nr)
 {
@@ -1346,8 +1360,7 @@ static int gup_huge_pmd(pmd_t orig, pmd_t *pmdp, unsigned long addr,
 
 	if (unlikely(pmd_val(orig) != pmd_val(*pmdp))) {
 		*nr -= refs;
-		while (refs--)
-			put_page(head);
+		gup_put_huge_refs(head, refs);
 		return 0;
 	}
 
@@ -1381,8 +1394,7 @@ static int gup_huge_pud(pud_t orig, pud_t *pudp, unsigned long addr,
 
 	if (unlikely(pud_val(orig) != pud_val(*pudp))) {
 		*nr -= refs;
-		while (refs--)
-			put_page(head);
+		gup_put_huge_refs(head, refs);
 		return 0;
 	}
 
@@ -1417,8 +1429,7 @@ static int gup_huge_pgd(pgd_t orig, pgd_t *pgdp, unsigned long addr,
 
 	if (unlikely(pgd_val(orig) != pgd_val(*pgdp))) {
 		*nr -= refs;
-		while (refs--)
-			put_page(head);
+		gup_put_huge_refs(head, refs);
 		return 0;
 	}
 
@@ -1572,30 +1583,113 @@ int __get_user_pages_fast(unsigned long start, int nr_pages, int write,
 int get_user_pages_fast(unsigned long start, int nr_pages, int write,
 			struct page **pages)
 {
-	int nr, ret;
+	if (nr_pages <= 0)
+		return 0;
+
+	return get_user_pages_fast_batch(start, nr_pages,
+					 write ? FOLL_WRITE : 0, pages);
+}
+
+#endif /* CONFIG_HAVE_GENERIC_RCU_GUP */
+
+/*
+ * Pages pinned per lockless walk.  Each walk runs with interrupts off, so
+ * large ranges mapped with small pages are pinned in several walks.
+ */
+#define GUP_FAST_BATCH		512
+
+struct gup_fast_stat {
+	unsigned long calls;
+	unsigned long fast_pages;	/* pinned by the lockless walk */
+	unsigned long fallbacks;	/* batches that needed mmap_sem */
+	unsigned long slow_pages;	/* pinned by get_user_pages_unlocked() */
+};
+
+static DEFINE_PER_CPU(struct gup_fast_stat, gup_fast_stat);
+
+/**
+ * get_user_pages_fast_batch() - pin a range of user pages in batches
+ * @start:	starting user address
+ * @nr_pages:	number of pages from start to pin
+ * @gup_flags:	flags modifying lookup behaviour, FOLL_WRITE in particular
+ * @pages:	array that receives pointers to the pages pinned.
+ *		Should be at least nr_pages long.
+ *
+ * Like get_user_pages_fast(), but the range is walked GUP_FAST_BATCH pages
+ * at a time without mmap_sem.  Only a batch that the lockless walk cannot
+ * complete is finished with get_user_pages_unlocked(), after which the
+ * following batches go back to the lockless walk.  As with
+ * get_user_pages_fast(), every page returned holds one reference: for
+ * huge PMD and PUD mappings all of them are taken on the head page, one
+ * per subpage, and the caller drops them with one put_page() per entry
+ * in @pages.  Fallbacks are counted in debugfs/gup_fast.
+ *
+ * Returns number of pages pinned. This may be fewer than the number
+ * requested. If no pages were pinned, returns -errno.
+ */
+long get_user_pages_fast_batch(unsigned long start, unsigned long nr_pages,
+			       unsigned int gup_flags, struct page **pages)
+{
+	int write = !!(gup_flags & FOLL_WRITE);
+	unsigned long done = 0;
+	long ret = 0;
 
 	start &= PAGE_MASK;
-	nr = __get_user_pages_fast(start, nr_pages, write, pages);
-	ret = nr;
-
-	if (nr < nr_pages) {
-		/* Try to get the remaining pages with get_user_pages */
-		start += nr << PAGE_SHIFT;
-		pages += nr;
-
-		ret = get_user_pages_unlocked(start, nr_pages - nr, pages,
-				write ? FOLL_WRITE : 0);
-
-		/* Have to be a bit careful with return values */
-		if (nr > 0) {
-			if (ret < 0)
-				ret = nr;
-			else
-				ret += nr;
-		}
+	this_cpu_inc(gup_fast_stat.calls);
+
+	while (done < nr_pages) {
+		unsigned long addr = start + (done << PAGE_SHIFT);
+		int batch = min_t(unsigned long, nr_pages - done,
+				  GUP_FAST_BATCH);
+		int nr;
+
+		nr = __get_user_pages_fast(addr, batch, write, pages + done);
+		this_cpu_add(gup_fast_stat.fast_pages, nr);
+		done += nr;
+		if (nr == batch)
+			continue;
+
+		/* Fault in the rest of this batch with mmap_sem held */
+		this_cpu_inc(gup_fast_stat.fallbacks);
+		addr += (unsigned long)nr << PAGE_SHIFT;
+		ret = get_user_pages_unlocked(addr, batch - nr, pages + done,
+					      gup_flags);
+		if (ret <= 0)
+			break;
+		this_cpu_add(gup_fast_stat.slow_pages, ret);
+		done += ret;
+		if (ret < batch - nr)
+			break;
 	}
 
-	return ret;
+	return done ? done : ret;
 }
+EXPORT_SYMBOL_GPL(get_user_pages_fast_batch);
 
-#endif /* CONFIG_HAVE_GENERIC_RCU_GUP */
+#ifdef CONFIG_DEBUG_FS
+static int gup_fast_stat_show(struct seq_file *m, void *v)
+{
+	struct gup_fast_stat sum;
+
+	percpu_stat_sum(&gup_fast_stat, &sum);
+	seq_printf(m, "calls %lu fast_pages %lu fallbacks %lu slow_pages %lu\n",
+		   sum.calls, sum.fast_pages, sum.fallbacks, sum.slow_pages);
+	return 0;
+}
+
+static void gup_fast_stat_reset(void *data)
+{
+	percpu_stat_reset(&gup_fast_stat);
+}
+
+DEFINE_DEBUGFS_STAT(gup_fast_stat);
+
+static int __init gup_fast_stat_debugfs(void)
+{
+	if (!debugfs_create_file("gup_fast", 0600, NULL, NULL,
+				 &gup_fast_stat_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(gup_fast_stat_debugfs);
+#endif /* CONFIG_DEBUG_FS */
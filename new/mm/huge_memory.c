@@ -755,6 +755,264 @@ int do_huge_pmd_anonymous_page(struct vm_fault *vmf)
 	return __do_huge_pmd_anonymous_page(vmf, page, gfp);
 }
 
+/*
+ * Synchronous collapse, for callers which want a range backed by huge
+ * pages now rather than whenever khugepaged gets to it.  Only private
+ * anonymous memory is handled.  mmap_sem is held for write throughout,
+ * so the VMA and the upper page table levels cannot change under us.
+ */
+
+/* undo collapse_isolate_ptes() for one page */
+static void collapse_release_page(struct page *page)
+{
+	dec_node_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	unlock_page(page);
+	putback_lru_page(page);
+}
+
+/**
+ * collapse_isolate_ptes - lock and isolate the pages of a page table
+ * @vma: vma the page table maps
+ * @address: huge page aligned address
+ * @pte: the page table
+ *
+ * Fails on swap entries, pages which are not anonymous, pages which are
+ * already part of a compound page, and pages with references other than
+ * this mapping (e.g. GUP pins), which copying would silently break.
+ *
+ * Returns 0 with every mapped page locked and isolated, 1 if nothing at
+ * all is mapped, or -EBUSY with nothing isolated.
+ */
+static int collapse_isolate_ptes(struct vm_area_struct *vma,
+				 unsigned long address, pte_t *pte)
+{
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		struct page *page;
+
+		if (pte_none(pteval) || is_zero_pfn(pte_pfn(pteval))) {
+			none++;
+			continue;
+		}
+		if (!pte_present(pteval))
+			goto out;
+		page = vm_normal_page(vma, address, pteval);
+		if (unlikely(!page) || !PageAnon(page) || PageCompound(page))
+			goto out;
+		if (!trylock_page(page))
+			goto out;
+		if (page_count(page) != 1 + PageSwapCache(page) ||
+		    (PageSwapCache(page) && !reuse_swap_page(page, NULL)) ||
+		    isolate_lru_page(page)) {
+			unlock_page(page);
+			goto out;
+		}
+		inc_node_page_state(page,
+				NR_ISOLATED_ANON + page_is_file_cache(page));
+	}
+
+	return none == HPAGE_PMD_NR ? 1 : 0;
+out:
+	while (--_pte >= pte) {
+		pte_t pteval = *_pte;
+
+		if (!pte_none(pteval) && !is_zero_pfn(pte_pfn(pteval)))
+			collapse_release_page(pte_page(pteval));
+	}
+	return -EBUSY;
+}
+
+/* copy the isolated pages into @page and drop the old mappings */
+static void collapse_copy_ptes(pte_t *pte, struct page *page,
+			       struct vm_area_struct *vma,
+			       unsigned long address, spinlock_t *ptl)
+{
+	pte_t *_pte;
+
+	for (_pte = pte; _pte < pte + HPAGE_PMD_NR;
+	     _pte++, page++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		struct page *src_page;
+
+		if (pte_none(pteval) || is_zero_pfn(pte_pfn(pteval))) {
+			clear_user_highpage(page, address);
+			add_mm_counter(vma->vm_mm, MM_ANONPAGES, 1);
+			if (is_zero_pfn(pte_pfn(pteval))) {
+				spin_lock(ptl);
+				pte_clear(vma->vm_mm, address, _pte);
+				spin_unlock(ptl);
+			}
+			continue;
+		}
+
+		src_page = pte_page(pteval);
+		copy_user_highpage(page, src_page, address, vma);
+		VM_BUG_ON_PAGE(page_mapcount(src_page) != 1, src_page);
+		collapse_release_page(src_page);
+		spin_lock(ptl);
+		pte_clear(vma->vm_mm, address, _pte);
+		page_remove_rmap(src_page, false);
+		spin_unlock(ptl);
+		free_page_and_swap_cache(src_page);
+	}
+}
+
+/*
+ * Collapse the page table at @address into one huge page.  Returns 0 on
+ * success, 1 if there was nothing to collapse (no page table, or already
+ * a huge pmd), or a negative errno.
+ */
+static int collapse_huge_pmd(struct vm_area_struct *vma, unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long mmun_start = address;
+	unsigned long mmun_end = address + HPAGE_PMD_SIZE;
+	struct mem_cgroup *memcg;
+	struct page *new_page;
+	spinlock_t *pmd_ptl, *pte_ptl;
+	pgtable_t pgtable;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	gfp_t gfp;
+	int ret;
+
+	/* NULL for both an empty and an already huge pmd */
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd)
+		return 1;
+
+	/*
+	 * The range was asked for explicitly, so allow direct reclaim and
+	 * compaction whatever the defrag setting.
+	 */
+	gfp = GFP_TRANSHUGE;
+	new_page = alloc_hugepage_vma(gfp, vma, address, HPAGE_PMD_ORDER);
+	if (unlikely(!new_page)) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return -ENOMEM;
+	}
+	prep_transhuge_page(new_page);
+	count_vm_event(THP_COLLAPSE_ALLOC);
+
+	if (unlikely(mem_cgroup_try_charge(new_page, mm, gfp, &memcg, true))) {
+		put_page(new_page);
+		return -ENOMEM;
+	}
+
+	anon_vma_lock_write(vma->anon_vma);
+
+	pte = pte_offset_map(pmd, address);
+	pte_ptl = pte_lockptr(mm, pmd);
+
+	/*
+	 * Clear the pmd and flush the TLB so that no CPU can walk the page
+	 * table, and no gup_fast can pin its pages, while they are copied.
+	 */
+	mmu_notifier_invalidate_range_start(mm, mmun_start, mmun_end);
+	pmd_ptl = pmd_lock(mm, pmd);
+	_pmd = pmdp_collapse_flush(vma, address, pmd);
+	spin_unlock(pmd_ptl);
+	mmu_notifier_invalidate_range_end(mm, mmun_start, mmun_end);
+
+	spin_lock(pte_ptl);
+	ret = collapse_isolate_ptes(vma, address, pte);
+	spin_unlock(pte_ptl);
+
+	if (unlikely(ret)) {
+		pte_unmap(pte);
+		spin_lock(pmd_ptl);
+		BUG_ON(!pmd_none(*pmd));
+		/* nothing was touched, put the page table back */
+		pmd_populate(mm, pmd, pmd_pgtable(_pmd));
+		spin_unlock(pmd_ptl);
+		anon_vma_unlock_write(vma->anon_vma);
+		mem_cgroup_cancel_charge(new_page, memcg, true);
+		put_page(new_page);
+		return ret;
+	}
+
+	/* the pages are isolated and locked, rmap walks will skip them */
+	anon_vma_unlock_write(vma->anon_vma);
+
+	collapse_copy_ptes(pte, new_page, vma, address, pte_ptl);
+	pte_unmap(pte);
+	__SetPageUptodate(new_page);
+	pgtable = pmd_pgtable(_pmd);
+
+	_pmd = mk_huge_pmd(new_page, vma->vm_page_prot);
+	_pmd = maybe_pmd_mkwrite(pmd_mkdirty(_pmd), vma);
+
+	/*
+	 * spin_lock() below is not the equivalent of smp_wmb(), so this is
+	 * needed to keep the copies from becoming visible after the
+	 * set_pmd_at() write.
+	 */
+	smp_wmb();
+
+	spin_lock(pmd_ptl);
+	BUG_ON(!pmd_none(*pmd));
+	page_add_new_anon_rmap(new_page, vma, address, true);
+	mem_cgroup_commit_charge(new_page, memcg, false, true);
+	lru_cache_add_active_or_unevictable(new_page, vma);
+	pgtable_trans_huge_deposit(mm, pmd, pgtable);
+	set_pmd_at(mm, address, pmd, _pmd);
+	update_mmu_cache_pmd(vma, address, pmd);
+	spin_unlock(pmd_ptl);
+
+	return 0;
+}
+
+/**
+ * madvise_collapse_huge - collapse a range into transparent huge pages now
+ * @vma: vma containing the range
+ * @prev: madvise's previous vma cursor
+ * @start: start of the range
+ * @end: end of the range
+ *
+ * Called from madvise() with mmap_sem held for write.  Every huge page
+ * aligned part of [@start, @end) that is mapped by a page table is
+ * collapsed in place; parts which are already huge or entirely unmapped
+ * are left alone.
+ *
+ * Returns 0 if every eligible pmd was collapsed, -EINVAL if the vma cannot
+ * hold transparent huge pages, or -ENOMEM/-EAGAIN if some pmds could not
+ * be collapsed.
+ */
+int madvise_collapse_huge(struct vm_area_struct *vma,
+			  struct vm_area_struct **prev,
+			  unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+	int ret, err = 0;
+
+	*prev = vma;
+
+	if (!vma_is_anonymous(vma) || (vma->vm_flags & VM_NOHUGEPAGE) ||
+	    is_vm_hugetlb_page(vma) || userfaultfd_armed(vma))
+		return -EINVAL;
+
+	/* nothing was ever faulted in */
+	if (!vma->anon_vma)
+		return 0;
+
+	/* pages still sitting in lru pagevecs hold an extra reference */
+	lru_add_drain_all();
+
+	for (addr = ALIGN(start, HPAGE_PMD_SIZE);
+	     addr + HPAGE_PMD_SIZE <= end; addr += HPAGE_PMD_SIZE) {
+		cond_resched();
+		ret = collapse_huge_pmd(vma, addr);
+		if (ret < 0 && err != -ENOMEM)
+			err = ret == -ENOMEM ? ret : -EAGAIN;
+	}
+
+	return err;
+}
+
 static void insert_pfn_pmd(struct vm_area_struct *vma, unsigned long addr,
 		pmd_t *pmd, pfn_t pfn, pgprot_t prot, bool write)
 {
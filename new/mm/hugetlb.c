@@ -52,6 +52,8 @@
 #include <linux/swapops.h>
 #include <linux/page-isolation.h>
 #include <linux/jhash.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -1191,6 +1193,8 @@ static inline bool gigantic_page_supported(void) { return false; }
 static inline void free_gigantic_page(struct page *page, unsigned int order) { }
 static inline void destroy_compound_gigantic_page(struct page *page,
 						unsigned int order) { }
+static inline struct page *alloc_fresh_gigantic_page_node(struct hstate *h,
+					int nid) { return NULL; }
 static inline int alloc_fresh_gigantic_page(struct hstate *h,
 					nodemask_t *nodes_allowed) { return 0; }
 #endif
@@ -1440,6 +1444,132 @@ static int alloc_fresh_huge_page(struct hstate *h, nodemask_t *nodes_allowed)
 	return ret;
 }
 
+/*
+ * Growing the pool by many pages is split into per-node work items, so
+ * that the pages are allocated by several CPUs of each node at once
+ * rather than one by one by the writer of nr_hugepages.  Gigantic pages
+ * get a single worker per node, as concurrent contiguous range scans of
+ * the same zones would only get in each other's way.
+ */
+#define HUGETLB_GROW_WORKERS_PER_NODE	4
+
+struct hugetlb_grow_work {
+	struct work_struct	work;
+	struct hstate		*h;
+	int			nid;
+	unsigned long		nr_wanted;
+	unsigned long		nr_allocated;
+	bool			*abort;
+};
+
+/* size and duration of the last pool growth of each hstate */
+static unsigned long hugetlb_grow_pages[HUGE_MAX_HSTATE];
+static unsigned long hugetlb_grow_msecs[HUGE_MAX_HSTATE];
+
+static void hugetlb_grow_workfn(struct work_struct *work)
+{
+	struct hugetlb_grow_work *gw = container_of(work,
+					struct hugetlb_grow_work, work);
+	struct hstate *h = gw->h;
+	struct page *page;
+
+	while (gw->nr_allocated < gw->nr_wanted) {
+		/* the writer of nr_hugepages got killed */
+		if (READ_ONCE(*gw->abort))
+			break;
+		if (hstate_is_gigantic(h)) {
+			page = alloc_fresh_gigantic_page_node(h, gw->nid);
+		} else {
+			page = alloc_fresh_huge_page_node(h, gw->nid);
+			count_vm_event(page ? HTLB_BUDDY_PGALLOC :
+					      HTLB_BUDDY_PGALLOC_FAIL);
+		}
+		if (!page)
+			break;
+		gw->nr_allocated++;
+		cond_resched();
+	}
+}
+
+/**
+ * hugetlb_pool_grow - allocate fresh huge pages on several nodes in parallel
+ * @h: hstate to grow
+ * @count: number of pages wanted
+ * @nodes_allowed: nodes to allocate on
+ *
+ * @count is spread evenly over @nodes_allowed, as the round-robin serial
+ * allocation would do.  Must be called without hugetlb_lock held.
+ *
+ * Returns the number of pages added to the pool.  This falls short of
+ * @count when some node runs out of huge pages; the caller can then try
+ * the remaining nodes one page at a time.  It also falls short when the
+ * caller gets a fatal signal: the workers still running stop at their
+ * next page, as the serial loop stops on signals.
+ */
+static unsigned long hugetlb_pool_grow(struct hstate *h, unsigned long count,
+				       nodemask_t *nodes_allowed)
+{
+	struct hugetlb_grow_work *works;
+	unsigned long allocated = 0;
+	bool abort = false;
+	int nr_nodes, max_workers, nr_works = 0, n = 0;
+	int node, i;
+	ktime_t start;
+
+	nr_nodes = nodes_weight(*nodes_allowed);
+	if (!count || !nr_nodes)
+		return 0;
+
+	max_workers = hstate_is_gigantic(h) ? 1 : HUGETLB_GROW_WORKERS_PER_NODE;
+	works = kcalloc(nr_nodes * max_workers, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		return 0;
+
+	start = ktime_get();
+	for_each_node_mask(node, *nodes_allowed) {
+		unsigned long share = count / nr_nodes + (n++ < count % nr_nodes);
+		int cpu = cpumask_any_and(cpumask_of_node(node), cpu_online_mask);
+		int workers;
+
+		if (!share)
+			continue;
+
+		workers = min_t(unsigned long, share,
+				max(1U, nr_cpus_node(node)));
+		workers = min(workers, max_workers);
+		/* memory only node: let the workqueue pick a cpu */
+		if (cpu >= nr_cpu_ids)
+			cpu = WORK_CPU_UNBOUND;
+
+		for (i = 0; i < workers; i++) {
+			struct hugetlb_grow_work *gw = &works[nr_works++];
+
+			INIT_WORK(&gw->work, hugetlb_grow_workfn);
+			gw->h = h;
+			gw->nid = node;
+			gw->nr_wanted = share / workers + (i < share % workers);
+			gw->abort = &abort;
+			queue_work_on(cpu, system_unbound_wq, &gw->work);
+		}
+	}
+
+	for (i = 0; i < nr_works; i++) {
+		if (!abort && fatal_signal_pending(current))
+			WRITE_ONCE(abort, true);
+		flush_work(&works[i].work);
+		allocated += works[i].nr_allocated;
+	}
+
+	hugetlb_grow_pages[hstate_index(h)] = allocated;
+	hugetlb_grow_msecs[hstate_index(h)] = ktime_ms_delta(ktime_get(), start);
+	pr_info_ratelimited("HugeTLB: allocated %lu of %lu %lu kB pages with %d workers in %lu ms\n",
+			    allocated, count, huge_page_size(h) >> 10, nr_works,
+			    hugetlb_grow_msecs[hstate_index(h)]);
+
+	kfree(works);
+	return allocated;
+}
+
 /*
  * Free huge page from pool from next node to free.
  * Attempt to keep persistent huge pages more or less
@@ -2219,9 +2349,14 @@ static void __init gather_bootmem_prealloc(void)
 
 static void __init hugetlb_hstate_alloc_pages(struct hstate *h)
 {
-	unsigned long i;
+	unsigned long i = 0;
+
+	/* gigantic pages come from bootmem this early, one at a time */
+	if (!hstate_is_gigantic(h))
+		i = hugetlb_pool_grow(h, h->max_huge_pages,
+				      &node_states[N_MEMORY]);
 
-	for (i = 0; i < h->max_huge_pages; ++i) {
+	for (; i < h->max_huge_pages; ++i) {
 		if (hstate_is_gigantic(h)) {
 			if (!alloc_bootmem_huge_page(h))
 				break;
@@ -2359,6 +2494,21 @@ static unsigned long set_max_huge_pages(struct hstate *h, unsigned long count,
 			break;
 	}
 
+	/*
+	 * Allocate the bulk of the pages in parallel, the loop below only
+	 * has to make up for nodes which ran short.
+	 */
+	if (count > persistent_huge_pages(h)) {
+		unsigned long nr = count - persistent_huge_pages(h);
+
+		spin_unlock(&hugetlb_lock);
+		hugetlb_pool_grow(h, nr, nodes_allowed);
+		spin_lock(&hugetlb_lock);
+		/* Bail for signals, as the loop below does */
+		if (signal_pending(current))
+			goto out;
+	}
+
 	while (count > persistent_huge_pages(h)) {
 		/*
 		 * If this allocation races such that we no longer need the
@@ -2622,12 +2772,30 @@ static ssize_t surplus_hugepages_show(struct kobject *kobj,
 }
 HSTATE_ATTR_RO(surplus_hugepages);
 
+static ssize_t pool_grow_pages_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	struct hstate *h = kobj_to_hstate(kobj, NULL);
+	return sprintf(buf, "%lu\n", hugetlb_grow_pages[hstate_index(h)]);
+}
+HSTATE_ATTR_RO(pool_grow_pages);
+
+static ssize_t pool_grow_msecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	struct hstate *h = kobj_to_hstate(kobj, NULL);
+	return sprintf(buf, "%lu\n", hugetlb_grow_msecs[hstate_index(h)]);
+}
+HSTATE_ATTR_RO(pool_grow_msecs);
+
 static struct attribute *hstate_attrs[] = {
 	&nr_hugepages_attr.attr,
 	&nr_overcommit_hugepages_attr.attr,
 	&free_hugepages_attr.attr,
 	&resv_hugepages_attr.attr,
 	&surplus_hugepages_attr.attr,
+	&pool_grow_pages_attr.attr,
+	&pool_grow_msecs_attr.attr,
 #ifdef CONFIG_NUMA
 	&nr_hugepages_mempolicy_attr.attr,
 #endif
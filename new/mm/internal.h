@@ -86,12 +86,29 @@ extern unsigned long highest_memmap_pfn;
 extern int isolate_lru_page(struct page *page);
 extern void putback_lru_page(struct page *page);
 extern bool pgdat_reclaimable(struct pglist_data *pgdat);
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_putback_page(struct page *page, struct lruvec *lruvec);
+#else
+static inline void lru_gen_putback_page(struct page *page,
+					struct lruvec *lruvec)
+{
+}
+#endif
 
 /*
  * in mm/rmap.c:
  */
 extern pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address);
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * in mm/huge_memory.c:
+ */
+extern int madvise_collapse_huge(struct vm_area_struct *vma,
+				 struct vm_area_struct **prev,
+				 unsigned long start, unsigned long end);
+#endif
+
 /*
  * in mm/page_alloc.c
  */
@@ -203,6 +220,7 @@ struct compact_control {
 	bool ignore_block_suitable;	/* Scan blocks considered unsuitable */
 	bool direct_compaction;		/* False from kcompactd or /proc/... */
 	bool whole_zone;		/* Whole zone should/has been scanned */
+	bool proactive_compaction;	/* kcompactd proactive compaction */
 	int order;			/* order a direct compactor needs */
 	const gfp_t gfp_mask;		/* gfp mask of a direct compactor */
 	const unsigned int alloc_flags;	/* alloc flags of a direct compactor */
@@ -289,6 +307,34 @@ static inline bool is_data_mapping(vm_flags_t flags)
 void __vma_link_list(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct vm_area_struct *prev, struct rb_node *rb_parent);
 
+/*
+ * Dirty throttling statistics of a backing_dev_info, filled in by
+ * balance_dirty_pages() and shown in debugfs/bdi/<dev>/throttle.
+ * Histograms have log2 buckets.  They live in a hash in backing-dev.c
+ * keyed by the bdi, see bdi_throttle_stats().
+ */
+#define BDI_THROTTLE_BUCKETS	24
+
+struct bdi_throttle_stats {
+	struct hlist_node node;
+	struct backing_dev_info *bdi;
+	struct dentry *debug_throttle;
+	struct rcu_head rcu;
+	atomic_long_t pause_ms[BDI_THROTTLE_BUCKETS];
+	atomic_long_t task_ratelimit[BDI_THROTTLE_BUCKETS];	/* kB/s */
+	atomic_long_t write_bw[BDI_THROTTLE_BUCKETS];		/* kB/s */
+	atomic_long_t pos_ratio[BDI_THROTTLE_BUCKETS];		/* x/1024 */
+	atomic_long_t freerun;		/* below the freerun ceiling */
+	atomic_long_t short_pause;	/* pause below min_pause, carried over */
+	atomic_long_t clamped;		/* pause cut down to max_pause */
+	atomic_long_t zero_ratelimit;	/* task_ratelimit was 0 */
+	atomic_long_t memcg_limited;	/* memcg domain was the tighter one */
+	atomic_long_t dirty_exceeded;
+};
+
+extern struct bdi_throttle_stats *bdi_throttle_stats(
+					struct backing_dev_info *bdi);
+
 #ifdef CONFIG_MMU
 extern long populate_vma_page_range(struct vm_area_struct *vma,
 		unsigned long start, unsigned long end, int *nonblocking);
@@ -494,6 +540,7 @@ struct tlbflush_unmap_batch;
 #ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
 void try_to_unmap_flush(void);
 void try_to_unmap_flush_dirty(void);
+void flush_tlb_batched_pending(struct mm_struct *mm);
 #else
 static inline void try_to_unmap_flush(void)
 {
@@ -501,6 +548,9 @@ static inline void try_to_unmap_flush(void)
 static inline void try_to_unmap_flush_dirty(void)
 {
 }
+static inline void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+}
 
 #endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
 
@@ -142,12 +142,14 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @scanner: id of the ksm_scan cursor which owns this mm_slot
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned int scanner;
 };
 
 /**
@@ -155,17 +157,30 @@ struct mm_slot {
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @id: index of this cursor, matched against mm_slot->scanner
+ * @pass_done: this cursor has finished its share of the current full scan
+ * @at_end: reached the end of its share, pass_done is due once the pages
+ *	gathered before are merged
+ * @nr_exits: bumped when an exiting mm's rmap_items are all freed
+ * @thread: the ksmd thread driving this cursor
  *
- * There is only the one ksm_scan instance of this cursor structure.
+ * There is one ksm_scan cursor per scanner thread: each only visits the
+ * mm_slots assigned to it, and a full scan completes once all of them
+ * have walked their share of the mm_slot list.
  */
 struct ksm_scan {
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
-	unsigned long seqnr;
+	unsigned int id;
+	bool pass_done;
+	bool at_end;
+	unsigned long nr_exits;
+	struct task_struct *thread;
 };
 
+#define KSM_MAX_SCANNERS	16
+
 /**
  * struct stable_node - node of the stable rbtree
  * @node: rb node of this ksm page in the stable tree
@@ -198,6 +213,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @checksummed: oldchecksum was taken on an earlier visit
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -213,6 +229,7 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	bool checksummed;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -241,10 +258,27 @@ static DEFINE_HASHTABLE(mm_slots_hash, MM_SLOTS_HASH_BITS);
 static struct mm_slot ksm_mm_head = {
 	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
 };
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
+static struct ksm_scan ksm_scans[KSM_MAX_SCANNERS] = {
+	[0 ... KSM_MAX_SCANNERS - 1] = {
+		.mm_slot = &ksm_mm_head,
+	},
 };
 
+/* Number of scanner threads partitioning the mm_slot list */
+static unsigned int ksm_nr_scanners = 1;
+
+/* Number of scanners which have finished the current full scan */
+static unsigned int ksm_scanners_done;
+
+/* Round robin assignment of new mm_slots to scanners */
+static unsigned int ksm_next_scanner;
+
+/* Count of completed full scans (needed when removing unstable node) */
+static unsigned long ksm_seqnr;
+
+/* Bumped whenever rmap_items may be freed behind a scanner's back */
+static unsigned long ksm_scan_generation;
+
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
@@ -261,6 +295,22 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* The number of pages looked at by the scanners */
+static unsigned long ksm_pages_scanned;
+
+/* The number of page slots merged into a ksm page */
+static unsigned long ksm_pages_merged;
+
+/* The number of pages skipped because their checksum changed */
+static unsigned long ksm_pages_checksum_skipped;
+
+/* Scan and merge rates, in pages per second, over the last full scan */
+static unsigned long ksm_scan_rate;
+static unsigned long ksm_merge_rate;
+static unsigned long ksm_pass_start;
+static unsigned long ksm_pass_scanned;
+static unsigned long ksm_pass_merged;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
@@ -684,7 +734,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(ksm_seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
 			rb_erase(&rmap_item->node,
@@ -707,6 +757,37 @@ static void remove_trailing_rmap_items(struct mm_slot *mm_slot,
 	}
 }
 
+/*
+ * Send every scanner back to the head of the mm_slot list.  Caller must
+ * hold ksm_thread_mutex and ksm_mmlist_lock; any scanner which dropped
+ * ksm_thread_mutex in the middle of a page will notice the generation
+ * change and throw its rmap_item away.
+ */
+static void ksm_reset_scanners(void)
+{
+	int i;
+
+	for (i = 0; i < KSM_MAX_SCANNERS; i++) {
+		ksm_scans[i].mm_slot = &ksm_mm_head;
+		ksm_scans[i].pass_done = false;
+		ksm_scans[i].at_end = false;
+	}
+	ksm_scanners_done = 0;
+	ksm_scan_generation++;
+	wake_up_interruptible(&ksm_thread_wait);
+}
+
+/* Is any scanner's cursor on this mm_slot?  Caller holds ksm_mmlist_lock */
+static bool ksm_slot_is_scanned(struct mm_slot *mm_slot)
+{
+	int i;
+
+	for (i = 0; i < KSM_MAX_SCANNERS; i++)
+		if (ksm_scans[i].mm_slot == mm_slot)
+			return true;
+	return false;
+}
+
 /*
  * Though it's very tempting to unmerge rmap_items from stable tree rather
  * than check every pte of a given vma, the locking doesn't quite work for
@@ -806,18 +887,21 @@ static int remove_all_stable_nodes(void)
 
 static int unmerge_and_remove_all_rmap_items(void)
 {
+	struct ksm_scan *scan = &ksm_scans[0];
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
+	int nid;
 	int err = 0;
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	ksm_reset_scanners();
+	scan->mm_slot = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = scan->mm_slot;
+			mm_slot != &ksm_mm_head; mm_slot = scan->mm_slot) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
@@ -835,7 +919,7 @@ static int unmerge_and_remove_all_rmap_items(void)
 		up_read(&mm->mmap_sem);
 
 		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
+		scan->mm_slot = list_entry(mm_slot->mm_list.next,
 						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
 			hash_del(&mm_slot->link);
@@ -851,13 +935,15 @@ static int unmerge_and_remove_all_rmap_items(void)
 
 	/* Clean up stable nodes, but don't worry if some are still busy */
 	remove_all_stable_nodes();
-	ksm_scan.seqnr = 0;
+	for (nid = 0; nid < ksm_nr_node_ids; nid++)
+		root_unstable_tree[nid] = RB_ROOT;
+	ksm_seqnr = 0;
 	return 0;
 
 error:
 	up_read(&mm->mmap_sem);
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
+	scan->mm_slot = &ksm_mm_head;
 	spin_unlock(&ksm_mmlist_lock);
 	return err;
 }
@@ -1379,6 +1465,22 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+
+		/*
+		 * The unstable tree is ordered by checksum first: pages with
+		 * different checksums cannot be identical, so most of the
+		 * walk is done without looking up or comparing tree pages.
+		 * The checksum of a node is stable while it is in the tree.
+		 */
+		if (rmap_item->oldchecksum != tree_rmap_item->oldchecksum) {
+			parent = *new;
+			if (rmap_item->oldchecksum < tree_rmap_item->oldchecksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (!tree_page)
 			return NULL;
@@ -1416,7 +1518,7 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (ksm_seqnr & SEQNR_MASK);
 	DO_NUMA(rmap_item->nid = nid);
 	rb_link_node(&rmap_item->node, parent, new);
 	rb_insert_color(&rmap_item->node, root);
@@ -1441,6 +1543,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	ksm_pages_merged++;
 }
 
 /*
@@ -1451,8 +1554,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
+ * @precomputed: checksum of the page if the caller already calculated it
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
+			       const unsigned int *precomputed)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
@@ -1514,9 +1619,13 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 *添加一个新节点。但是如果在不稳定树中发现了页面，则合并该页面，
 	 *然后将该节点迁移到稳定树中。
 	 */
-	checksum = calc_checksum(page);
-	if (rmap_item->oldchecksum != checksum) {
+	checksum = precomputed ? *precomputed : calc_checksum(page);
+	if (rmap_item->oldchecksum != checksum ||
+	    unlikely(!rmap_item->checksummed)) {
 		rmap_item->oldchecksum = checksum;
+		if (rmap_item->checksummed)
+			ksm_pages_checksum_skipped++;
+		rmap_item->checksummed = true;
 		return;
 	}
 
@@ -1581,66 +1690,122 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/* Next mm_slot owned by this scanner, caller holds ksm_mmlist_lock */
+static struct mm_slot *ksm_next_mm_slot(struct ksm_scan *scan,
+					struct mm_slot *slot)
+{
+	do {
+		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
+	} while (slot != &ksm_mm_head && slot->scanner != scan->id);
+
+	return slot;
+}
+
+static void ksm_update_scan_rates(void)
+{
+	unsigned long elapsed = jiffies - ksm_pass_start;
+
+	if (elapsed) {
+		ksm_scan_rate = mult_frac(ksm_pages_scanned - ksm_pass_scanned,
+					  HZ, elapsed);
+		ksm_merge_rate = mult_frac(ksm_pages_merged - ksm_pass_merged,
+					   HZ, elapsed);
+	}
+	ksm_pass_start = jiffies;
+	ksm_pass_scanned = ksm_pages_scanned;
+	ksm_pass_merged = ksm_pages_merged;
+}
+
+/*
+ * Called with ksm_thread_mutex held when a scanner has walked all of its
+ * mm_slots.  The last scanner to get here completes the full scan and
+ * prepares the next one, so the unstable tree is only reset once every
+ * scanner is done with it.
+ */
+static void ksm_scan_pass_done(struct ksm_scan *scan)
+{
+	int nid, i;
+
+	scan->pass_done = true;
+	if (++ksm_scanners_done < ksm_nr_scanners)
+		return;
+
+	ksm_seqnr++;
+	ksm_update_scan_rates();
+
+	/*
+	 * A number of pages can hang around indefinitely on per-cpu
+	 * pagevecs, raised page count preventing write_protect_page
+	 * from merging them.  Though it doesn't really matter much,
+	 * it is puzzling to see some stuck in pages_volatile until
+	 * other activity jostles them out, and they also prevented
+	 * LTP's KSM test from succeeding deterministically; so drain
+	 * them here (here rather than on entry to ksm_do_scan(),
+	 * so we don't IPI too often when pages_to_scan is set low).
+	 */
+	lru_add_drain_all();
+
+	/*
+	 * Whereas stale stable_nodes on the stable_tree itself
+	 * get pruned in the regular course of stable_tree_search(),
+	 * those moved out to the migrate_nodes list can accumulate:
+	 * so prune them once before each full scan.
+	 */
+	if (!ksm_merge_across_nodes) {
+		struct stable_node *stable_node, *next;
+		struct page *page;
+
+		list_for_each_entry_safe(stable_node, next,
+					 &migrate_nodes, list) {
+			page = get_ksm_page(stable_node, false);
+			if (page)
+				put_page(page);
+			cond_resched();
+		}
+	}
+
+	for (nid = 0; nid < ksm_nr_node_ids; nid++)
+		root_unstable_tree[nid] = RB_ROOT;
+
+	for (i = 0; i < KSM_MAX_SCANNERS; i++)
+		ksm_scans[i].pass_done = false;
+	ksm_scanners_done = 0;
+	wake_up_interruptible(&ksm_thread_wait);
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						  struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
-	int nid;
 
 	if (list_empty(&ksm_mm_head.mm_list))
 		return NULL;
 
-	slot = ksm_scan.mm_slot;
+	slot = scan->mm_slot;
 	if (slot == &ksm_mm_head) {
-		/*
-		 * A number of pages can hang around indefinitely on per-cpu
-		 * pagevecs, raised page count preventing write_protect_page
-		 * from merging them.  Though it doesn't really matter much,
-		 * it is puzzling to see some stuck in pages_volatile until
-		 * other activity jostles them out, and they also prevented
-		 * LTP's KSM test from succeeding deterministically; so drain
-		 * them here (here rather than on entry to ksm_do_scan(),
-		 * so we don't IPI too often when pages_to_scan is set low).
-		 */
-		lru_add_drain_all();
-
-		/*
-		 * Whereas stale stable_nodes on the stable_tree itself
-		 * get pruned in the regular course of stable_tree_search(),
-		 * those moved out to the migrate_nodes list can accumulate:
-		 * so prune them once before each full scan.
-		 */
-		if (!ksm_merge_across_nodes) {
-			struct stable_node *stable_node, *next;
-			struct page *page;
-
-			list_for_each_entry_safe(stable_node, next,
-						 &migrate_nodes, list) {
-				page = get_ksm_page(stable_node, false);
-				if (page)
-					put_page(page);
-				cond_resched();
-			}
-		}
-
-		for (nid = 0; nid < ksm_nr_node_ids; nid++)
-			root_unstable_tree[nid] = RB_ROOT;
+		/* Wait for the other scanners to finish this full scan */
+		if (scan->pass_done)
+			return NULL;
 
 		spin_lock(&ksm_mmlist_lock);
-		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
+		slot = ksm_next_mm_slot(scan, slot);
+		scan->mm_slot = slot;
 		spin_unlock(&ksm_mmlist_lock);
 		/*
 		 * Although we tested list_empty() above, a racing __ksm_exit
-		 * of the last mm on the list may have removed it since then.
+		 * of the last mm on the list may have removed it since then;
+		 * or no mm_slot may be assigned to this scanner at all.
 		 */
-		if (slot == &ksm_mm_head)
+		if (slot == &ksm_mm_head) {
+			scan->at_end = true;
 			return NULL;
+		}
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -1648,59 +1813,59 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (IS_ERR_OR_NULL(*page)) {
-				ksm_scan.address += PAGE_SIZE;
+				scan->address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
 			if (PageAnon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
 				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+					scan->rmap_list, scan->address);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
 				return rmap_item;
 			}
 			put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
+		scan->nr_exits++;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	remove_trailing_rmap_items(slot, scan->rmap_list);
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
-						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	scan->mm_slot = ksm_next_mm_slot(scan, slot);
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1725,64 +1890,137 @@ next_mm:
 		 * spin_unlock(&ksm_mmlist_lock) run, the "mm" may
 		 * already have been freed under us by __ksm_exit()
 		 * because the "mm_slot" is still hashed and
-		 * ksm_scan.mm_slot doesn't point to it anymore.
+		 * no scan->mm_slot points to it anymore.
 		 */
 		spin_unlock(&ksm_mmlist_lock);
 	}
 
 	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
+	slot = scan->mm_slot;
 	if (slot != &ksm_mm_head)
 		goto next_mm;
 
-	ksm_scan.seqnr++;
+	scan->at_end = true;
 	return NULL;
 }
 
+/* Pages a scanner takes per ksm_thread_mutex round trip */
+#define KSM_SCAN_BATCH	16
+
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the scanner cursor to advance.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * Called with ksm_thread_mutex held.  When several scanners are running,
+ * each gathers a batch of pages, checksums the whole batch with the mutex
+ * dropped, then compares and merges it with the mutex held again: so one
+ * scanner's checksums overlap with another's tree work, and the mutex
+ * changes hands once per batch rather than once per page.  The trees
+ * themselves are only ever touched under the mutex.
+ *
+ * The end of a scanner's share is only reported to ksm_scan_pass_done()
+ * once the batch is merged: the last scanner to report bumps ksm_seqnr
+ * and resets the unstable tree, which the rmap_items of a pending batch
+ * must not see.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
-	struct rmap_item *rmap_item;
-	struct page *uninitialized_var(page);
+	struct rmap_item *rmap_items[KSM_SCAN_BATCH];
+	struct page *pages[KSM_SCAN_BATCH];
+	unsigned int checksums[KSM_SCAN_BATCH];
+	unsigned long summed, generation, exits;
+	int batch, nr, i;
+
+	batch = ksm_nr_scanners > 1 ? KSM_SCAN_BATCH : 1;
 
-	while (scan_npages-- && likely(!freezing(current))) {
+	while (scan_npages && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
-		if (!rmap_item)
-			return;
-		cmp_and_merge_page(page, rmap_item);
-		put_page(page);
+		exits = scan->nr_exits;
+		for (nr = 0; nr < batch && scan_npages; scan_npages--) {
+			rmap_items[nr] = scan_get_next_rmap_item(scan, &pages[nr]);
+			/* An exiting mm took the rmap_items gathered before */
+			if (unlikely(scan->nr_exits != exits)) {
+				exits = scan->nr_exits;
+				for (i = 0; i < nr; i++)
+					put_page(pages[i]);
+				rmap_items[0] = rmap_items[nr];
+				pages[0] = pages[nr];
+				nr = 0;
+			}
+			if (!rmap_items[nr]) {
+				scan_npages = 0;
+				break;
+			}
+			ksm_pages_scanned++;
+			nr++;
+		}
+
+		summed = 0;
+		if (batch > 1 && nr) {
+			generation = ksm_scan_generation;
+			mutex_unlock(&ksm_thread_mutex);
+			for (i = 0; i < nr; i++) {
+				if (PageKsm(pages[i]))
+					continue;
+				checksums[i] = calc_checksum(pages[i]);
+				summed |= 1UL << i;
+			}
+			mutex_lock(&ksm_thread_mutex);
+			wait_while_offlining();
+			if (generation != ksm_scan_generation) {
+				for (i = 0; i < nr; i++)
+					put_page(pages[i]);
+				return;
+			}
+		}
+
+		for (i = 0; i < nr; i++) {
+			cmp_and_merge_page(pages[i], rmap_items[i],
+				summed & (1UL << i) ? &checksums[i] : NULL);
+			put_page(pages[i]);
+			cond_resched();
+		}
+
+		if (scan->at_end) {
+			scan->at_end = false;
+			ksm_scan_pass_done(scan);
+		}
 	}
 }
 
-static int ksmd_should_run(void)
+/*
+ * A scanner done with its share of the full scan sleeps until the last one
+ * finishes it, see ksm_scan_pass_done().
+ */
+static int ksmd_should_run(struct ksm_scan *scan)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list) &&
+		scan->id < ksm_nr_scanners && !READ_ONCE(scan->pass_done);
 }
 
-static int ksm_scan_thread(void *nothing)
+static int ksm_scan_thread(void *data)
 {
+	struct ksm_scan *scan = data;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
 		wait_while_offlining();
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run(scan))
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
 
-		if (ksmd_should_run()) {
+		if (ksmd_should_run(scan)) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
-				ksmd_should_run() || kthread_should_stop());
+				ksmd_should_run(scan) || kthread_should_stop());
 		}
 	}
 	return 0;
@@ -1849,9 +2087,10 @@ int __ksm_enter(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
+	mm_slot->scanner = ksm_next_scanner++ % ksm_nr_scanners;
 	/*
 	 * When KSM_RUN_MERGE (or KSM_RUN_STOP),
-	 * insert just behind the scanning cursor, to let the area settle
+	 * insert just behind its scanning cursor, to let the area settle
 	 * down a little; when fork is followed by immediate exec, we don't
 	 * want ksmd to waste time setting up and tearing down an rmap_list.
 	 *
@@ -1862,7 +2101,8 @@ int __ksm_enter(struct mm_struct *mm)
 	if (ksm_run & KSM_RUN_UNMERGE)
 		list_add_tail(&mm_slot->mm_list, &ksm_mm_head.mm_list);
 	else
-		list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+		list_add_tail(&mm_slot->mm_list,
+			      &ksm_scans[mm_slot->scanner].mm_slot->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -1890,14 +2130,14 @@ void __ksm_exit(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	if (mm_slot && !ksm_slot_is_scanned(mm_slot)) {
 		if (!mm_slot->rmap_list) {
 			hash_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			easy_to_free = 1;
 		} else {
 			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+				  &ksm_scans[mm_slot->scanner].mm_slot->mm_list);
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -2327,10 +2567,111 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", ksm_seqnr);
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t pages_checksum_skipped_show(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_checksum_skipped);
+}
+KSM_ATTR_RO(pages_checksum_skipped);
+
+static ssize_t scan_rate_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_scan_rate);
+}
+KSM_ATTR_RO(scan_rate);
+
+static ssize_t merge_rate_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_merge_rate);
+}
+KSM_ATTR_RO(merge_rate);
+
+static ssize_t nr_threads_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_nr_scanners);
+}
+
+static ssize_t nr_threads_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	static DEFINE_MUTEX(ksm_nr_threads_mutex);
+	struct task_struct *thread;
+	struct mm_slot *mm_slot;
+	unsigned int nr, i;
+	int err;
+
+	err = kstrtouint(buf, 10, &nr);
+	if (err || !nr || nr > KSM_MAX_SCANNERS)
+		return -EINVAL;
+
+	mutex_lock(&ksm_nr_threads_mutex);
+	for (i = 1; i < nr; i++) {
+		if (ksm_scans[i].thread)
+			continue;
+		thread = kthread_run(ksm_scan_thread, &ksm_scans[i],
+				     "ksmd/%u", i);
+		if (IS_ERR(thread)) {
+			pr_err("ksm: creating kthread failed\n");
+			err = PTR_ERR(thread);
+			nr = i;
+			break;
+		}
+		ksm_scans[i].thread = thread;
+	}
+
+	/*
+	 * Repartition the mm_slots and restart every cursor from the head
+	 * of the list: the full scan in progress carries on, so rmap_items
+	 * already in the unstable tree are simply revisited.
+	 */
+	mutex_lock(&ksm_thread_mutex);
+	wait_while_offlining();
+	spin_lock(&ksm_mmlist_lock);
+	ksm_nr_scanners = nr;
+	i = 0;
+	list_for_each_entry(mm_slot, &ksm_mm_head.mm_list, mm_list)
+		mm_slot->scanner = i++ % nr;
+	ksm_reset_scanners();
+	spin_unlock(&ksm_mmlist_lock);
+	mutex_unlock(&ksm_thread_mutex);
+
+	for (i = nr; i < KSM_MAX_SCANNERS; i++) {
+		if (!ksm_scans[i].thread)
+			continue;
+		kthread_stop(ksm_scans[i].thread);
+		ksm_scans[i].thread = NULL;
+	}
+	mutex_unlock(&ksm_nr_threads_mutex);
+
+	wake_up_interruptible(&ksm_thread_wait);
+
+	return err ? err : count;
+}
+KSM_ATTR(nr_threads);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -2340,6 +2681,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_merged_attr.attr,
+	&pages_checksum_skipped_attr.attr,
+	&scan_rate_attr.attr,
+	&merge_rate_attr.attr,
+	&nr_threads_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
@@ -2355,18 +2702,23 @@ static struct attribute_group ksm_attr_group = {
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
-	int err;
+	int err, i;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
+	for (i = 0; i < KSM_MAX_SCANNERS; i++)
+		ksm_scans[i].id = i;
+	ksm_pass_start = jiffies;
+
+	ksm_thread = kthread_run(ksm_scan_thread, &ksm_scans[0], "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		pr_err("ksm: creating kthread failed\n");
 		err = PTR_ERR(ksm_thread);
 		goto out_free;
 	}
+	ksm_scans[0].thread = ksm_thread;
 
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
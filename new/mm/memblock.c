@@ -113,19 +113,39 @@ static unsigned long __init_memblock memblock_addrs_overlap(phys_addr_t base1, p
 	return ((base1 < (base2 + size2)) && (base2 < (base1 + size1)));
 }
 
+/*
+ * Regions of a type are sorted and never overlap, so their ends are
+ * sorted as well.  Binary search for the first region ending above @addr;
+ * returns type->cnt if there is none.  Everything before that index lies
+ * entirely below @addr, so range walks can start there instead of at 0.
+ */
+static int __init_memblock memblock_first_region_above(struct memblock_type *type,
+						       phys_addr_t addr)
+{
+	unsigned int left = 0, right = type->cnt;
+
+	while (left < right) {
+		unsigned int mid = (right + left) / 2;
+
+		if (type->regions[mid].base + type->regions[mid].size <= addr)
+			left = mid + 1;
+		else
+			right = mid;
+	}
+	return left;
+}
+
 /**
  * 在type查找与[base, base+size)重叠的区域, 返回idx.
  */
 bool __init_memblock memblock_overlaps_region(struct memblock_type *type,
 					phys_addr_t base, phys_addr_t size)
 {
-	unsigned long i;
+	int i = memblock_first_region_above(type, base);
 
-	for (i = 0; i < type->cnt; i++)
-		if (memblock_addrs_overlap(base, size, type->regions[i].base,
-					   type->regions[i].size))
-			break;
-	return i < type->cnt;
+	return i < type->cnt &&
+		memblock_addrs_overlap(base, size, type->regions[i].base,
+				       type->regions[i].size);
 }
 
 /*
@@ -490,15 +510,20 @@ static int __init_memblock memblock_double_array(struct memblock_type *type,
 /**
  * memblock_merge_regions - merge neighboring compatible regions
  * @type: memblock type to scan
+ * @start_rgn: first region to try merging with its successor
+ * @end_rgn: region index to stop at
  *
- * Scan @type and merge neighboring compatible regions.
+ * Scan regions [@start_rgn, @end_rgn) of @type and merge each with the
+ * following region if they are compatible.  Callers pass the window
+ * around the regions they modified, the rest of @type is already minimal.
  */
-static void __init_memblock memblock_merge_regions(struct memblock_type *type)
+static void __init_memblock memblock_merge_regions(struct memblock_type *type,
+						   int start_rgn, int end_rgn)
 {
-	int i = 0;
+	int i = max(start_rgn, 0);
 
 	/* cnt never goes below 1 */
-	while (i < type->cnt - 1) {
+	while (i < end_rgn && i < type->cnt - 1) {
 		struct memblock_region *this = &type->regions[i];
 		struct memblock_region *next = &type->regions[i + 1];
 
@@ -515,6 +540,7 @@ static void __init_memblock memblock_merge_regions(struct memblock_type *type)
 		/* move forward from next + 1, index of which is i + 2 */
 		memmove(next, next + 1, (type->cnt - (i + 2)) * sizeof(*next));
 		type->cnt--;
+		end_rgn--;
 	}
 }
 
@@ -586,7 +612,7 @@ int __init_memblock memblock_add_range(struct memblock_type *type,
  memblock_cap_size函数会设置size大小确保base + size不会溢出  
 */
 	phys_addr_t end = base + memblock_cap_size(base, &size);
-	int idx, nr_new;
+	int idx, nr_new, start_idx;
 	struct memblock_region *rgn;
 
 	if (!size)
@@ -611,12 +637,14 @@ repeat:
 	 */
 	base = obase;
 	nr_new = 0;
+	/* regions before this one end below @base, skip them */
+	start_idx = memblock_first_region_above(type, base);
 	
 	/*
 	 *不为空的情况下，则先检查是否存在内存重叠的情况，
 	 *如果有的话，则剔除重叠部分，然后将其余非重叠的部分添加进去
 	 */
-	for_each_memblock_type(type, rgn) {
+	for_each_memblock_type_from(type, rgn, start_idx) {
 		phys_addr_t rbase = rgn->base;
 		phys_addr_t rend = rbase + rgn->size;
 
@@ -691,7 +719,8 @@ repeat:
 		goto repeat;
 	} else {
 		/* 把紧挨着的内存合并 */
-		memblock_merge_regions(type);
+		/* only the new regions and their neighbours can merge */
+		memblock_merge_regions(type, start_idx - 1, idx + 1);
 		return 0;
 	}
 }
@@ -746,7 +775,8 @@ static int __init_memblock memblock_isolate_range(struct memblock_type *type,
 		if (memblock_double_array(type, base, size) < 0)
 			return -ENOMEM;
 
-	for_each_memblock_type(type, rgn) {
+	for_each_memblock_type_from(type, rgn,
+				    memblock_first_region_above(type, base)) {
 		phys_addr_t rbase = rgn->base;
 		phys_addr_t rend = rbase + rgn->size;
 
@@ -875,7 +905,7 @@ static int __init_memblock memblock_setclr_flag(phys_addr_t base,
 		else
 			memblock_clear_region_flags(&type->regions[i], flag);
 
-	memblock_merge_regions(type);
+	memblock_merge_regions(type, start_rgn - 1, end_rgn);
 	return 0;
 }
 
@@ -1272,7 +1302,7 @@ int __init_memblock memblock_set_node(phys_addr_t base, phys_addr_t size,
 	for (i = start_rgn; i < end_rgn; i++)
 		memblock_set_region_node(&type->regions[i], nid);
 
-	memblock_merge_regions(type);
+	memblock_merge_regions(type, start_rgn - 1, end_rgn);
 	return 0;
 }
 #endif /* CONFIG_HAVE_MEMBLOCK_NODE_MAP */
@@ -1191,6 +1191,7 @@ again:
 	init_rss_vec(rss);
 	start_pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
 	pte = start_pte;
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -2877,6 +2878,110 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+/*
+ * Anonymous fault-around: a write fault right behind an already mapped
+ * page looks like a sequential first touch, so a few more zeroed pages
+ * following it are mapped in one go.  The window is anon_fault_around_bytes,
+ * set in debugfs, capped at ANON_FAULT_AROUND_MAX pages and off (one page)
+ * by default.  Pages are only mapped into empty ptes of the same page table.
+ */
+#define ANON_FAULT_AROUND_MAX	16
+
+static unsigned long anon_fault_around_bytes __read_mostly = PAGE_SIZE;
+
+static unsigned long anon_fault_around_pages(void)
+{
+	return min_t(unsigned long,
+		     READ_ONCE(anon_fault_around_bytes) >> PAGE_SHIFT,
+		     ANON_FAULT_AROUND_MAX);
+}
+
+/* Is the page right before the fault address in this page table mapped? */
+static bool anon_fault_sequential(struct vm_fault *vmf)
+{
+	unsigned long prev = vmf->address - PAGE_SIZE;
+	pte_t *pte;
+	bool ret;
+
+	if (!(vmf->address & ~PMD_MASK) || prev < vmf->vma->vm_start)
+		return false;
+
+	pte = pte_offset_map(vmf->pmd, prev);
+	ret = pte_present(READ_ONCE(*pte));
+	pte_unmap(pte);
+	return ret;
+}
+
+/*
+ * Map up to @nr zeroed pages after the fault address.  This is purely
+ * opportunistic: the pages may never be touched, so neither allocation
+ * nor charging may reclaim for them, and anything that fails or finds
+ * the pte populated is simply dropped.
+ */
+static void do_anon_fault_around(struct vm_fault *vmf, unsigned long nr)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct page *pages[ANON_FAULT_AROUND_MAX];
+	struct mem_cgroup *memcgs[ANON_FAULT_AROUND_MAX];
+	unsigned long start = vmf->address + PAGE_SIZE;
+	unsigned long addr;
+	spinlock_t *ptl;
+	pte_t *pte, *start_pte;
+	int i, allocated;
+
+	/* Stay inside the vma and the page table of the fault */
+	if (!(start & ~PMD_MASK))
+		return;
+	nr = min(nr, (vma->vm_end - start) >> PAGE_SHIFT);
+	nr = min(nr, (PMD_SIZE - (start & ~PMD_MASK)) >> PAGE_SHIFT);
+
+	for (i = 0, addr = start; i < nr; i++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		page = alloc_page_vma((GFP_HIGHUSER_MOVABLE &
+				       ~__GFP_DIRECT_RECLAIM) | __GFP_NOWARN,
+				      vma, addr);
+		if (!page)
+			break;
+		clear_user_highpage(page, addr);
+		if (mem_cgroup_try_charge(page, vma->vm_mm, GFP_NOWAIT,
+					  &memcgs[i], false)) {
+			put_page(page);
+			break;
+		}
+		__SetPageUptodate(page);
+		pages[i] = page;
+	}
+	allocated = i;
+	if (!allocated)
+		return;
+
+	start_pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, start, &ptl);
+	for (i = 0, pte = start_pte, addr = start; i < allocated;
+	     i++, pte++, addr += PAGE_SIZE) {
+		struct page *page = pages[i];
+		pte_t entry;
+
+		if (!pte_none(*pte)) {
+			mem_cgroup_cancel_charge(page, memcgs[i], false);
+			put_page(page);
+			continue;
+		}
+
+		entry = mk_pte(page, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+
+		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, addr, false);
+		mem_cgroup_commit_charge(page, memcgs[i], false, false);
+		lru_cache_add_active_or_unevictable(page, vma);
+		set_pte_at(vma->vm_mm, addr, pte, entry);
+		update_mmu_cache(vma, addr, pte);
+	}
+	pte_unmap_unlock(start_pte, ptl);
+}
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -2892,6 +2997,7 @@ static int do_anonymous_page(struct vm_fault *vmf)
 	struct vm_area_struct *vma = vmf->vma;
 	struct mem_cgroup *memcg;
 	struct page *page;
+	unsigned long around = 0;
 	pte_t entry;
 
 
@@ -2937,6 +3043,11 @@ static int do_anonymous_page(struct vm_fault *vmf)
 		goto setpte;
 	}
 
+	/* Sequential first touch: map a batch of pages after this one too */
+	if (anon_fault_around_pages() > 1 && !userfaultfd_armed(vma) &&
+	    anon_fault_sequential(vmf))
+		around = anon_fault_around_pages() - 1;
+
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
@@ -2981,6 +3092,10 @@ setpte:
 
 	/* No need to invalidate - it was non-present before */
 	update_mmu_cache(vma, vmf->address, vmf->pte);
+	pte_unmap_unlock(vmf->pte, vmf->ptl);
+	if (around)
+		do_anon_fault_around(vmf, around);
+	return 0;
 unlock:
 	pte_unmap_unlock(vmf->pte, vmf->ptl);
 	return 0;
@@ -3290,6 +3405,26 @@ static int fault_around_bytes_set(void *data, u64 val)
 DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
 		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
 
+static int anon_fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = anon_fault_around_bytes;
+	return 0;
+}
+
+static int anon_fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > ANON_FAULT_AROUND_MAX)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		anon_fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		anon_fault_around_bytes = PAGE_SIZE;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(anon_fault_around_bytes_fops,
+		anon_fault_around_bytes_get, anon_fault_around_bytes_set,
+		"%llu\n");
+
 static int __init fault_around_debugfs(void)
 {
 	void *ret;
@@ -3298,6 +3433,10 @@ static int __init fault_around_debugfs(void)
 			&fault_around_bytes_fops);
 	if (!ret)
 		pr_warn("Failed to create fault_around_bytes in debugfs");
+	ret = debugfs_create_file("anon_fault_around_bytes", 0644, NULL, NULL,
+			&anon_fault_around_bytes_fops);
+	if (!ret)
+		pr_warn("Failed to create anon_fault_around_bytes in debugfs");
 	return 0;
 }
 late_initcall(fault_around_debugfs);
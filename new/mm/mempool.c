@@ -16,10 +16,87 @@
 #include <linux/kmemleak.h>
 #include <linux/export.h>
 #include <linux/mempool.h>
+#include <linux/percpu.h>
 #include <linux/blkdev.h>
 #include <linux/writeback.h>
 #include "slab.h"
 
+/*
+ * Optional per-cpu caches, set up by mempool_create_percpu().  They hold
+ * part of the min_nr reserve: every cpu keeps up to pcp->max elements of
+ * it, pool->elements the rest.  When the backing allocator fails,
+ * mempool_alloc() takes from the local cache first, and mempool_free()
+ * refills the local cache first, both under a lock that only another cpu
+ * short of elements ever contends for.  pool->lock is taken only when the
+ * local cache is empty or full.  A cpu finding both its cache and the
+ * shared elements empty takes from the other cpus' caches, so the whole
+ * reserve stays available to every cpu.
+ *
+ * mempool_t has no room for the caches, so such a pool is embedded in a
+ * struct mempool_percpu.  Its alloc and free functions are the wrappers
+ * below, which is how the pool is told apart from the others, and which
+ * call the user's functions with the user's pool_data.
+ */
+#define MEMPOOL_PCP_MAX		16
+
+struct mempool_pcp {
+	spinlock_t lock;
+	int nr;
+	int max;
+	void *elements[MEMPOOL_PCP_MAX];
+};
+
+struct mempool_percpu {
+	mempool_t pool;
+	struct mempool_pcp __percpu *pcp;
+	mempool_alloc_t *alloc;
+	mempool_free_t *free;
+	void *pool_data;
+};
+
+static void *mempool_pcp_alloc(gfp_t gfp_mask, void *pool_data)
+{
+	struct mempool_percpu *ppool = pool_data;
+
+	return ppool->alloc(gfp_mask, ppool->pool_data);
+}
+
+static void mempool_pcp_free(void *element, void *pool_data)
+{
+	struct mempool_percpu *ppool = pool_data;
+
+	ppool->free(element, ppool->pool_data);
+}
+
+static inline struct mempool_percpu *to_mempool_percpu(mempool_t *pool)
+{
+	if (pool->alloc != mempool_pcp_alloc)
+		return NULL;
+	return container_of(pool, struct mempool_percpu, pool);
+}
+
+/* The user's functions and data, which the element checks go by */
+static inline mempool_alloc_t *mempool_alloc_fn(mempool_t *pool)
+{
+	struct mempool_percpu *ppool = to_mempool_percpu(pool);
+
+	return ppool ? ppool->alloc : pool->alloc;
+}
+
+static inline mempool_free_t *mempool_free_fn(mempool_t *pool)
+{
+	struct mempool_percpu *ppool = to_mempool_percpu(pool);
+
+	return ppool ? ppool->free : pool->free;
+}
+
+static inline void *mempool_pool_data(mempool_t *pool)
+{
+	struct mempool_percpu *ppool = to_mempool_percpu(pool);
+
+	return ppool ? ppool->pool_data : pool->pool_data;
+}
+
 #if defined(CONFIG_DEBUG_SLAB) || defined(CONFIG_SLUB_DEBUG_ON)
 static void poison_error(mempool_t *pool, void *element, size_t size,
 			 size_t byte)
@@ -56,13 +133,15 @@ static void __check_element(mempool_t *pool, void *element, size_t size)
 
 static void check_element(mempool_t *pool, void *element)
 {
+	mempool_free_t *free_fn = mempool_free_fn(pool);
+
 	/* Mempools backed by slab allocator */
-	if (pool->free == mempool_free_slab || pool->free == mempool_kfree)
+	if (free_fn == mempool_free_slab || free_fn == mempool_kfree)
 		__check_element(pool, element, ksize(element));
 
 	/* Mempools backed by page allocator */
-	if (pool->free == mempool_free_pages) {
-		int order = (int)(long)pool->pool_data;
+	if (free_fn == mempool_free_pages) {
+		int order = (int)(long)mempool_pool_data(pool);
 		void *addr = kmap_atomic((struct page *)element);
 
 		__check_element(pool, addr, 1UL << (PAGE_SHIFT + order));
@@ -80,13 +159,15 @@ static void __poison_element(void *element, size_t size)
 
 static void poison_element(mempool_t *pool, void *element)
 {
+	mempool_alloc_t *alloc_fn = mempool_alloc_fn(pool);
+
 	/* Mempools backed by slab allocator */
-	if (pool->alloc == mempool_alloc_slab || pool->alloc == mempool_kmalloc)
+	if (alloc_fn == mempool_alloc_slab || alloc_fn == mempool_kmalloc)
 		__poison_element(element, ksize(element));
 
 	/* Mempools backed by page allocator */
-	if (pool->alloc == mempool_alloc_pages) {
-		int order = (int)(long)pool->pool_data;
+	if (alloc_fn == mempool_alloc_pages) {
+		int order = (int)(long)mempool_pool_data(pool);
 		void *addr = kmap_atomic((struct page *)element);
 
 		__poison_element(addr, 1UL << (PAGE_SHIFT + order));
@@ -104,18 +185,24 @@ static inline void poison_element(mempool_t *pool, void *element)
 
 static void kasan_poison_element(mempool_t *pool, void *element)
 {
-	if (pool->alloc == mempool_alloc_slab || pool->alloc == mempool_kmalloc)
+	mempool_alloc_t *alloc_fn = mempool_alloc_fn(pool);
+
+	if (alloc_fn == mempool_alloc_slab || alloc_fn == mempool_kmalloc)
 		kasan_poison_kfree(element);
-	if (pool->alloc == mempool_alloc_pages)
-		kasan_free_pages(element, (unsigned long)pool->pool_data);
+	if (alloc_fn == mempool_alloc_pages)
+		kasan_free_pages(element,
+				 (unsigned long)mempool_pool_data(pool));
 }
 
 static void kasan_unpoison_element(mempool_t *pool, void *element, gfp_t flags)
 {
-	if (pool->alloc == mempool_alloc_slab || pool->alloc == mempool_kmalloc)
+	mempool_alloc_t *alloc_fn = mempool_alloc_fn(pool);
+
+	if (alloc_fn == mempool_alloc_slab || alloc_fn == mempool_kmalloc)
 		kasan_unpoison_slab(element);
-	if (pool->alloc == mempool_alloc_pages)
-		kasan_alloc_pages(element, (unsigned long)pool->pool_data);
+	if (alloc_fn == mempool_alloc_pages)
+		kasan_alloc_pages(element,
+				  (unsigned long)mempool_pool_data(pool));
 }
 
 static void add_element(mempool_t *pool, void *element)
@@ -136,6 +223,86 @@ static void *remove_element(mempool_t *pool, gfp_t flags)
 	return element;
 }
 
+static void *mempool_pcp_get(struct mempool_percpu *ppool, int cpu,
+			     gfp_t flags)
+{
+	struct mempool_pcp *pcp = per_cpu_ptr(ppool->pcp, cpu);
+	unsigned long irqflags;
+	void *element = NULL;
+
+	if (!READ_ONCE(pcp->nr))
+		return NULL;
+
+	spin_lock_irqsave(&pcp->lock, irqflags);
+	if (pcp->nr)
+		element = pcp->elements[--pcp->nr];
+	spin_unlock_irqrestore(&pcp->lock, irqflags);
+
+	if (element) {
+		kasan_unpoison_element(&ppool->pool, element, flags);
+		check_element(&ppool->pool, element);
+	}
+	return element;
+}
+
+/* Take a reserve element from whichever cpu's cache still has one */
+static void *mempool_pcp_steal(struct mempool_percpu *ppool, gfp_t flags)
+{
+	void *element;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		element = mempool_pcp_get(ppool, cpu, flags);
+		if (element)
+			return element;
+	}
+	return NULL;
+}
+
+static bool mempool_pcp_put(struct mempool_percpu *ppool, void *element)
+{
+	mempool_t *pool = &ppool->pool;
+	struct mempool_pcp *pcp;
+	unsigned long irqflags;
+	bool cached = false;
+
+	pcp = per_cpu_ptr(ppool->pcp, raw_smp_processor_id());
+	if (READ_ONCE(pcp->nr) >= pcp->max)
+		return false;
+
+	spin_lock_irqsave(&pcp->lock, irqflags);
+	if (pcp->nr < pcp->max) {
+		poison_element(pool, element);
+		kasan_poison_element(pool, element);
+		pcp->elements[pcp->nr++] = element;
+		cached = true;
+	}
+	spin_unlock_irqrestore(&pcp->lock, irqflags);
+
+	/* Waiters look at the caches after queueing, see mempool_alloc() */
+	if (cached && wq_has_sleeper(&pool->wait))
+		wake_up(&pool->wait);
+	return cached;
+}
+
+static void mempool_pcp_drain(struct mempool_percpu *ppool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mempool_pcp *pcp = per_cpu_ptr(ppool->pcp, cpu);
+
+		while (pcp->nr) {
+			void *element = pcp->elements[--pcp->nr];
+
+			kasan_unpoison_element(&ppool->pool, element,
+					       GFP_KERNEL);
+			check_element(&ppool->pool, element);
+			ppool->free(element, ppool->pool_data);
+		}
+	}
+}
+
 /**
  * mempool_destroy - deallocate a memory pool
  * @pool:      pointer to the memory pool which was allocated via
@@ -146,15 +313,26 @@ static void *remove_element(mempool_t *pool, gfp_t flags)
  */
 void mempool_destroy(mempool_t *pool)
 {
+	struct mempool_percpu *ppool;
+
 	if (unlikely(!pool))
 		return;
 
+	ppool = to_mempool_percpu(pool);
+	if (ppool && ppool->pcp) {
+		mempool_pcp_drain(ppool);
+		free_percpu(ppool->pcp);
+	}
+
 	while (pool->curr_nr) {
 		void *element = remove_element(pool, GFP_KERNEL);
 		pool->free(element, pool->pool_data);
 	}
 	kfree(pool->elements);
-	kfree(pool);
+	if (ppool)
+		kfree(ppool);
+	else
+		kfree(pool);
 }
 EXPORT_SYMBOL(mempool_destroy);
 
@@ -186,20 +364,15 @@ mempool_t *mempool_create(int min_nr, mempool_alloc_t *alloc_fn,
 }
 EXPORT_SYMBOL(mempool_create);
 
-mempool_t *mempool_create_node(int min_nr, mempool_alloc_t *alloc_fn,
-			       mempool_free_t *free_fn, void *pool_data,
-			       gfp_t gfp_mask, int node_id)
+/*
+ * Set up a zeroed @pool and fill its reserve.  On failure @pool, and the
+ * struct mempool_percpu around it if any, is freed.
+ */
+static mempool_t *mempool_init_node(mempool_t *pool, int min_nr,
+				    mempool_alloc_t *alloc_fn,
+				    mempool_free_t *free_fn, void *pool_data,
+				    gfp_t gfp_mask, int node_id)
 {
-	mempool_t *pool;
-	pool = kzalloc_node(sizeof(*pool), gfp_mask, node_id);
-	if (!pool)
-		return NULL;
-	pool->elements = kmalloc_node(min_nr * sizeof(void *),
-				      gfp_mask, node_id);
-	if (!pool->elements) {
-		kfree(pool);
-		return NULL;
-	}
 	spin_lock_init(&pool->lock);
 	pool->min_nr = min_nr;
 	pool->pool_data = pool_data;
@@ -207,6 +380,13 @@ mempool_t *mempool_create_node(int min_nr, mempool_alloc_t *alloc_fn,
 	pool->alloc = alloc_fn;
 	pool->free = free_fn;
 
+	pool->elements = kmalloc_node(min_nr * sizeof(void *),
+				      gfp_mask, node_id);
+	if (!pool->elements) {
+		mempool_destroy(pool);
+		return NULL;
+	}
+
 	/*
 	 * First pre-allocate the guaranteed number of buffers.
 	 */
@@ -222,8 +402,94 @@ mempool_t *mempool_create_node(int min_nr, mempool_alloc_t *alloc_fn,
 	}
 	return pool;
 }
+
+mempool_t *mempool_create_node(int min_nr, mempool_alloc_t *alloc_fn,
+			       mempool_free_t *free_fn, void *pool_data,
+			       gfp_t gfp_mask, int node_id)
+{
+	mempool_t *pool;
+	pool = kzalloc_node(sizeof(*pool), gfp_mask, node_id);
+	if (!pool)
+		return NULL;
+	return mempool_init_node(pool, min_nr, alloc_fn, free_fn, pool_data,
+				 gfp_mask, node_id);
+}
 EXPORT_SYMBOL(mempool_create_node);
 
+/**
+ * mempool_create_percpu - create a memory pool with per-cpu caches
+ * @min_nr:    the minimum number of elements guaranteed to be
+ *             allocated for this pool.
+ * @alloc_fn:  user-defined element-allocation function.
+ * @free_fn:   user-defined element-freeing function.
+ * @pool_data: optional private data available to the user-defined functions.
+ * @pcp_nr:    number of reserved elements each cpu keeps, at most
+ *             MEMPOOL_PCP_MAX.
+ *
+ * Like mempool_create(), but @pcp_nr of the @min_nr reserved elements
+ * live on every possible cpu, so that allocating from and refilling the
+ * reserve under memory pressure does not serialize on the pool lock.
+ * @pcp_nr is cut down so that at least one element stays shared; when
+ * @min_nr is too small for that, the pool gets no caches at all.
+ */
+mempool_t *mempool_create_percpu(int min_nr, mempool_alloc_t *alloc_fn,
+				 mempool_free_t *free_fn, void *pool_data,
+				 int pcp_nr)
+{
+	int cpus = num_possible_cpus();
+	struct mempool_percpu *ppool;
+	mempool_t *pool;
+	int cpu;
+
+	pcp_nr = min3(pcp_nr, MEMPOOL_PCP_MAX, (min_nr - 1) / cpus);
+	if (pcp_nr <= 0)
+		return mempool_create(min_nr, alloc_fn, free_fn, pool_data);
+
+	ppool = kzalloc(sizeof(*ppool), GFP_KERNEL);
+	if (!ppool)
+		return NULL;
+	ppool->alloc = alloc_fn;
+	ppool->free = free_fn;
+	ppool->pool_data = pool_data;
+
+	ppool->pcp = alloc_percpu(struct mempool_pcp);
+	if (!ppool->pcp) {
+		kfree(ppool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		struct mempool_pcp *pcp = per_cpu_ptr(ppool->pcp, cpu);
+
+		spin_lock_init(&pcp->lock);
+		pcp->max = pcp_nr;
+	}
+
+	pool = mempool_init_node(&ppool->pool, min_nr - pcp_nr * cpus,
+				 mempool_pcp_alloc, mempool_pcp_free, ppool,
+				 GFP_KERNEL, NUMA_NO_NODE);
+	if (!pool)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		struct mempool_pcp *pcp = per_cpu_ptr(ppool->pcp, cpu);
+
+		while (pcp->nr < pcp->max) {
+			void *element;
+
+			element = alloc_fn(GFP_KERNEL, pool_data);
+			if (unlikely(!element)) {
+				mempool_destroy(pool);
+				return NULL;
+			}
+			poison_element(pool, element);
+			kasan_poison_element(pool, element);
+			pcp->elements[pcp->nr++] = element;
+		}
+	}
+	return pool;
+}
+EXPORT_SYMBOL(mempool_create_percpu);
+
 /**
  * mempool_resize - resize an existing memory pool
  * @pool:       pointer to the memory pool which was allocated via
@@ -245,6 +511,7 @@ EXPORT_SYMBOL(mempool_create_node);
  */
 int mempool_resize(mempool_t *pool, int new_min_nr)
 {
+	struct mempool_percpu *ppool = to_mempool_percpu(pool);
 	void *element;
 	void **new_elements;
 	unsigned long flags;
@@ -252,6 +519,13 @@ int mempool_resize(mempool_t *pool, int new_min_nr)
 	BUG_ON(new_min_nr <= 0);
 	might_sleep();
 
+	/* The per-cpu caches keep their part, pool->min_nr is the rest */
+	if (ppool) {
+		new_min_nr -= num_possible_cpus() * raw_cpu_ptr(ppool->pcp)->max;
+		if (new_min_nr <= 0)
+			return -EINVAL;
+	}
+
 	spin_lock_irqsave(&pool->lock, flags);
 	if (new_min_nr <= pool->min_nr) {
 		while (new_min_nr < pool->curr_nr) {
@@ -322,6 +596,7 @@ EXPORT_SYMBOL(mempool_resize);
  */
 void *mempool_alloc(mempool_t *pool, gfp_t gfp_mask)
 {
+	struct mempool_percpu *ppool = to_mempool_percpu(pool);
 	void *element;
 	unsigned long flags;
 	wait_queue_t wait;
@@ -348,6 +623,14 @@ repeat_alloc:
 	if (likely(element != NULL))
 		return element;
 
+	/* This cpu's part of the reserve, without pool->lock */
+	if (ppool) {
+		element = mempool_pcp_get(ppool, raw_smp_processor_id(),
+					  gfp_temp);
+		if (element)
+			goto got_reserved;
+	}
+
 	/**
 	 * 从基本内存池中分配元素失败，从内存池中分配。
 	 *
@@ -368,6 +651,15 @@ repeat_alloc:
 		return element;
 	}
 
+	/* The parts of the reserve other cpus keep */
+	if (ppool) {
+		spin_unlock_irqrestore(&pool->lock, flags);
+		element = mempool_pcp_steal(ppool, gfp_temp);
+		if (element)
+			goto got_reserved;
+		spin_lock_irqsave(&pool->lock, flags);
+	}
+
 	/*
 	 * We use gfp mask w/o direct reclaim or IO for the first round.  If
 	 * alloc failed with that and @pool was empty, retry immediately.
@@ -397,6 +689,15 @@ repeat_alloc:
 
 	spin_unlock_irqrestore(&pool->lock, flags);
 
+	/* Frees to the per-cpu caches skip pool->lock, look again once queued */
+	if (ppool) {
+		element = mempool_pcp_steal(ppool, gfp_temp);
+		if (element) {
+			finish_wait(&pool->wait, &wait);
+			goto got_reserved;
+		}
+	}
+
 	/*
 	 * FIXME: this should be io_schedule().  The timeout is there as a
 	 * workaround for some DM problems in 2.6.18.
@@ -409,6 +710,12 @@ repeat_alloc:
 
 	finish_wait(&pool->wait, &wait);
 	goto repeat_alloc;
+
+got_reserved:
+	/* paired with rmb in mempool_free(), read comment there */
+	smp_wmb();
+	kmemleak_update_trace(element);
+	return element;
 }
 EXPORT_SYMBOL(mempool_alloc);
 
@@ -425,6 +732,7 @@ EXPORT_SYMBOL(mempool_alloc);
  */
 void mempool_free(void *element, mempool_t *pool)
 {
+	struct mempool_percpu *ppool = to_mempool_percpu(pool);
 	unsigned long flags;
 
 	if (unlikely(element == NULL))
@@ -446,6 +754,10 @@ void mempool_free(void *element, mempool_t *pool)
 	 */
 	smp_rmb();
 
+	/* This cpu's part of the reserve is refilled first */
+	if (ppool && mempool_pcp_put(ppool, element))
+		return;
+
 	/*
 	 * For correctness, we need a test which is guaranteed to trigger
 	 * if curr_nr + #allocated == min_nr.  Testing curr_nr < min_nr
@@ -476,6 +788,7 @@ void mempool_free(void *element, mempool_t *pool)
 		}
 		spin_unlock_irqrestore(&pool->lock, flags);
 	}
+
 	/**
 	 * 否则释放到基本内存分配器中。
 	 */
@@ -1583,6 +1583,36 @@ static inline void wb_dirty_limits(struct dirty_throttle_control *dtc)
 	}
 }
 
+/* Count @val in its log2 bucket, the last bucket takes everything above */
+static void bdi_throttle_hist(atomic_long_t *hist, unsigned long val)
+{
+	atomic_long_inc(&hist[min_t(int, fls_long(val),
+				    BDI_THROTTLE_BUCKETS - 1)]);
+}
+
+/* Record how one throttling round of balance_dirty_pages() was decided */
+static void bdi_throttle_account(struct bdi_throttle_stats *ts,
+				 struct bdi_writeback *wb,
+				 struct dirty_throttle_control *sdtc,
+				 unsigned long task_ratelimit,
+				 bool memcg_limited, bool dirty_exceeded)
+{
+	if (!ts)
+		return;
+
+	bdi_throttle_hist(ts->task_ratelimit,
+			  task_ratelimit << (PAGE_SHIFT - 10));
+	bdi_throttle_hist(ts->write_bw,
+			  wb->avg_write_bandwidth << (PAGE_SHIFT - 10));
+	bdi_throttle_hist(ts->pos_ratio, sdtc->pos_ratio);
+	if (memcg_limited)
+		atomic_long_inc(&ts->memcg_limited);
+	if (dirty_exceeded)
+		atomic_long_inc(&ts->dirty_exceeded);
+	if (!task_ratelimit)
+		atomic_long_inc(&ts->zero_ratelimit);
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
  * data.  It looks at the number of dirty pages in the machine and will force
@@ -1610,8 +1640,10 @@ static void balance_dirty_pages(struct address_space *mapping,
 	unsigned long task_ratelimit;
 	unsigned long dirty_ratelimit;
 	struct backing_dev_info *bdi = wb->bdi;
+	struct bdi_throttle_stats *ts = bdi_throttle_stats(bdi);
 	bool strictlimit = bdi->capabilities & BDI_CAP_STRICTLIMIT;
 	unsigned long start_time = jiffies;
+	unsigned long slept;
 
 	for (;;) {
 		unsigned long now = jiffies;
@@ -1694,6 +1726,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 			if (mdtc)
 				m_intv = dirty_poll_interval(m_dirty, m_thresh);
 			current->nr_dirtied_pause = min(intv, m_intv);
+			if (ts)
+				atomic_long_inc(&ts->freerun);
 			break;
 		}
 
@@ -1749,6 +1783,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 		min_pause = wb_min_pause(wb, max_pause,
 					 task_ratelimit, dirty_ratelimit,
 					 &nr_dirtied_pause);
+		bdi_throttle_account(ts, wb, sdtc, task_ratelimit,
+				     sdtc == mdtc, dirty_exceeded);
 
 		if (unlikely(task_ratelimit == 0)) {
 			period = max_pause;
@@ -1779,6 +1815,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 						  period,
 						  min(pause, 0L),
 						  start_time);
+			if (ts)
+				atomic_long_inc(&ts->short_pause);
 			if (pause < -HZ) {
 				current->dirty_paused_when = now;
 				current->nr_dirtied = 0;
@@ -1793,6 +1831,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 			/* for occasional dropped task_ratelimit */
 			now += min(pause - max_pause, max_pause);
 			pause = max_pause;
+			if (ts)
+				atomic_long_inc(&ts->clamped);
 		}
 
 pause:
@@ -1810,7 +1850,12 @@ pause:
 					  start_time);
 		__set_current_state(TASK_KILLABLE);
 		wb->dirty_sleep = now;
+		slept = jiffies;
 		io_schedule_timeout(pause);
+		/* what was slept, a fatal signal or wakeup may cut it short */
+		if (ts)
+			bdi_throttle_hist(ts->pause_ms,
+					  jiffies_to_msecs(jiffies - slept));
 
 		current->dirty_paused_when = now + pause;
 		current->nr_dirtied = 0;
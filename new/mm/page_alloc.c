@@ -65,6 +65,8 @@
 #include <linux/page_owner.h>
 #include <linux/kthread.h>
 #include <linux/memcontrol.h>
+#include <linux/debugfs_stat.h>
+#include <linux/jump_label.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
@@ -191,6 +193,8 @@ unsigned int pageblock_order __read_mostly;
 #endif
 
 static void __free_pages_ok(struct page *page, unsigned int order);
+static void __free_hot_cold_page(struct page *page, unsigned int order,
+				 bool cold);
 
 /*
  * results with 256, 32 in the lowmem_reserve sysctl:
@@ -1200,9 +1204,9 @@ static __always_inline bool free_pages_prepare(struct page *page,
 }
 
 #ifdef CONFIG_DEBUG_VM
-static inline bool free_pcp_prepare(struct page *page)
+static inline bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, true);
+	return free_pages_prepare(page, order, true);
 }
 
 static inline bool bulkfree_pcp_prepare(struct page *page)
@@ -1210,9 +1214,9 @@ static inline bool bulkfree_pcp_prepare(struct page *page)
 	return false;
 }
 #else
-static bool free_pcp_prepare(struct page *page)
+static bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, false);
+	return free_pages_prepare(page, order, false);
 }
 
 static bool bulkfree_pcp_prepare(struct page *page)
@@ -1221,10 +1225,184 @@ static bool bulkfree_pcp_prepare(struct page *page)
 }
 #endif /* CONFIG_DEBUG_VM */
 
+static inline unsigned int order_to_pindex(int migratetype, unsigned int order)
+{
+	return order * MIGRATE_PCPTYPES + migratetype;
+}
+
+static inline unsigned int pindex_to_order(unsigned int pindex)
+{
+	return pindex / MIGRATE_PCPTYPES;
+}
+
+static inline bool pcp_allowed_order(unsigned int order)
+{
+	return order <= PAGE_ALLOC_COSTLY_ORDER;
+}
+
+/*
+ * Number of order-sized blocks moved between the buddy lists and a pcp list
+ * at once. High orders move fewer blocks so that every refill or drain moves
+ * about pcp->batch base pages.
+ */
+static inline int pcp_order_batch(struct per_cpu_pages *pcp, unsigned int order)
+{
+	return max(READ_ONCE(pcp->batch) >> order, 1);
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * zone->lock hold time and buffered_rmqueue() latency histograms, in log2
+ * nanosecond buckets: bucket n counts samples in [2^(n-1), 2^n) ns. They
+ * are off by default and switched on through debugfs, so the only cost
+ * while disabled is a static branch.
+ */
+#define PCP_LATENCY_BUCKETS	32
+
+struct pcp_latency_hist {
+	unsigned long zone_lock[PCP_LATENCY_BUCKETS];
+	/* One row per pcp order, the last one for all costly orders */
+	unsigned long alloc[NR_PCP_ORDERS + 1][PCP_LATENCY_BUCKETS];
+};
+
+static DEFINE_STATIC_KEY_FALSE(pcp_latency_enabled);
+static DEFINE_PER_CPU(struct pcp_latency_hist, pcp_latency_hist);
+
+static inline u64 pcp_latency_start(void)
+{
+	if (static_branch_unlikely(&pcp_latency_enabled))
+		return local_clock();
+	return 0;
+}
+
+static inline unsigned int pcp_latency_bucket(u64 start)
+{
+	return min_t(unsigned int, fls64(local_clock() - start),
+		     PCP_LATENCY_BUCKETS - 1);
+}
+
+static inline void pcp_latency_lock_end(u64 start)
+{
+	if (start)
+		this_cpu_inc(pcp_latency_hist.zone_lock[pcp_latency_bucket(start)]);
+}
+
+static inline void pcp_latency_alloc_end(u64 start, unsigned int order)
+{
+	if (start)
+		this_cpu_inc(pcp_latency_hist.alloc[min_t(unsigned int, order,
+			NR_PCP_ORDERS)][pcp_latency_bucket(start)]);
+}
+
+static void pcp_latency_show_hist(struct seq_file *m, const char *name,
+				  size_t offset)
+{
+	unsigned long sum[PCP_LATENCY_BUCKETS] = { 0 };
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		unsigned long *hist = (void *)per_cpu_ptr(&pcp_latency_hist,
+							  cpu) + offset;
+
+		for (i = 0; i < PCP_LATENCY_BUCKETS; i++)
+			sum[i] += hist[i];
+	}
+
+	seq_printf(m, "%s:\n", name);
+	for (i = 0; i < PCP_LATENCY_BUCKETS; i++) {
+		if (!sum[i])
+			continue;
+		/* pcp_latency_bucket() puts everything above in the last one */
+		if (i == PCP_LATENCY_BUCKETS - 1)
+			seq_printf(m, "  >= %12llu%12s ns: %lu\n",
+				   1ULL << (i - 1), "", sum[i]);
+		else
+			seq_printf(m, "  %12llu - %12llu ns: %lu\n",
+				   i ? 1ULL << (i - 1) : 0ULL, (1ULL << i) - 1,
+				   sum[i]);
+	}
+}
+
+static int pcp_latency_show(struct seq_file *m, void *v)
+{
+	char name[32];
+	unsigned int order;
+
+	pcp_latency_show_hist(m, "zone_lock_hold",
+			offsetof(struct pcp_latency_hist, zone_lock));
+	for (order = 0; order <= NR_PCP_ORDERS; order++) {
+		if (order < NR_PCP_ORDERS)
+			snprintf(name, sizeof(name), "alloc_order_%u", order);
+		else
+			snprintf(name, sizeof(name), "alloc_order_costly");
+		pcp_latency_show_hist(m, name,
+			offsetof(struct pcp_latency_hist, alloc[order]));
+	}
+	return 0;
+}
+
+static void pcp_latency_reset(void *data)
+{
+	percpu_stat_reset(&pcp_latency_hist);
+}
+
+DEFINE_DEBUGFS_STAT(pcp_latency);
+
+static int pcp_latency_enable_get(void *data, u64 *val)
+{
+	*val = static_key_enabled(&pcp_latency_enabled);
+	return 0;
+}
+
+static int pcp_latency_enable_set(void *data, u64 val)
+{
+	if (val)
+		static_branch_enable(&pcp_latency_enabled);
+	else
+		static_branch_disable(&pcp_latency_enabled);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(pcp_latency_enable_fops, pcp_latency_enable_get,
+			pcp_latency_enable_set, "%llu\n");
+
+static int __init pcp_latency_debugfs(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("page_alloc", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("latency_enable", 0600, dir, NULL,
+				 &pcp_latency_enable_fops) ||
+	    !debugfs_create_file("latency", 0600, dir, NULL,
+				 &pcp_latency_fops)) {
+		debugfs_remove_recursive(dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+late_initcall(pcp_latency_debugfs);
+#else
+static inline u64 pcp_latency_start(void)
+{
+	return 0;
+}
+
+static inline void pcp_latency_lock_end(u64 start)
+{
+}
+
+static inline void pcp_latency_alloc_end(u64 start, unsigned int order)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * Assumes all pages on list are in same zone.
+ * count is the number of base pages to free; pcp->count is updated here.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -1240,10 +1418,11 @@ static bool bulkfree_pcp_prepare(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	int pindex = 0;
 	int batch_free = 0;
 	unsigned long nr_scanned;
 	bool isolated_pageblocks;
+	u64 start;
 
     /**
          * 虽然管理区可以按照CPU节点分类，但是也可以跨CPU节点进行内存分配，
@@ -1251,15 +1430,17 @@ static void free_pcppages_bulk(struct zone *zone, int count,
          * 使用每CPU缓存的目的，也是为了减少使用这把锁。
       */
 	spin_lock(&zone->lock);
+	start = pcp_latency_start();
 	isolated_pageblocks = has_isolate_pageblock(zone);
 	nr_scanned = node_page_state(zone->zone_pgdat, NR_PAGES_SCANNED);
 	if (nr_scanned)
 		__mod_node_page_state(zone->zone_pgdat, NR_PAGES_SCANNED, -nr_scanned);
 
     /* 连续释放指定数量的页面到伙伴系统 */
-	while (count) {
+	while (count > 0) {
 		struct page *page;
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -1275,17 +1456,19 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		/* batch_free是最后扫描的链表索引 */
 			batch_free++;
 			/* 只从MIGRATE_UNMOVABLE..MIGRATE_MOVABLE三个链表中选择页面。从这三个链表中循环选择回收的页面 */
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 			/* 如果当前链表为空，则从下一个缓存链表中释放页面 */
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
 		/* 只有一个缓存链表中有可回收页面，则从该链表中释放所有页面 */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = count;
 
+		order = pindex_to_order(pindex);
+
         /* 本循环从最后一个页面缓存链表中释放多个页面
                   到伙伴系统，越靠后的缓存链表，释放的页面数量越多 */
 		do {
@@ -1297,6 +1480,8 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			/* must delete as __free_one_page list manipulates */
 			/* 将页面从链表中摘除 */
 			list_del(&page->lru);
+			pcp->count -= 1 << order;
+			count -= 1 << order;
 
 			mt = get_pcppage_migratetype(page);
 			/* MIGRATE_ISOLATE page should not go to pcplists */
@@ -1310,11 +1495,12 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 
             /* 将页面释放回伙伴系统。注意这里没有用migratetype变量，
                      而是用页面属性中的migratetype。原因请参见英文注释 */
-			__free_one_page(page, page_to_pfn(page), zone, 0, mt);
+			__free_one_page(page, page_to_pfn(page), zone, order, mt);
             /* 调试代码 */
-			trace_mm_page_pcpu_drain(page, 0, mt);
-		} while (--count && --batch_free && !list_empty(list));
+			trace_mm_page_pcpu_drain(page, order, mt);
+		} while (count > 0 && --batch_free && !list_empty(list));
 	}
+	pcp_latency_lock_end(start);
 	spin_unlock(&zone->lock);
 }
 
@@ -1327,8 +1513,10 @@ static void free_one_page(struct zone *zone,
 				int migratetype)
 {
 	unsigned long nr_scanned;
+	u64 start;
 	/* 获得管理区的自旋锁 */
 	spin_lock(&zone->lock);
+	start = pcp_latency_start();
 	nr_scanned = node_page_state(zone->zone_pgdat, NR_PAGES_SCANNED);
 	if (nr_scanned)
 		__mod_node_page_state(zone->zone_pgdat, NR_PAGES_SCANNED, -nr_scanned);
@@ -1339,6 +1527,7 @@ static void free_one_page(struct zone *zone,
 	}
     /*将页面释放回伙伴系统 */
 	__free_one_page(page, pfn, zone, order, migratetype);
+	pcp_latency_lock_end(start);
 	spin_unlock(&zone->lock);
 }
 
@@ -1424,6 +1613,12 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	int migratetype;
 	unsigned long pfn = page_to_pfn(page);
 
+	/* Small orders are cached on the pcp lists like order-0 pages */
+	if (pcp_allowed_order(order)) {
+		__free_hot_cold_page(page, order, false);
+		return;
+	}
+
     /* 如果释放页面失败(如重要的管理结构被破坏，或者错误的调用参数)则退出 */
 	if (!free_pages_prepare(page, order, true))
 		return;
@@ -1943,40 +2138,40 @@ static inline bool free_pages_prezeroed(bool poisoned)
 		page_poisoning_enabled() && poisoned;
 }
 
+static bool check_new_pages(struct page *page, unsigned int order)
+{
+	int i;
+	for (i = 0; i < (1 << order); i++) {
+		struct page *p = page + i;
+
+		if (unlikely(check_new_page(p)))
+			return true;
+	}
+
+	return false;
+}
+
 #ifdef CONFIG_DEBUG_VM
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
 	return false;
 }
 
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
 #else
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
 	return false;
 }
 #endif /* CONFIG_DEBUG_VM */
 
-static bool check_new_pages(struct page *page, unsigned int order)
-{
-	int i;
-	for (i = 0; i < (1 << order); i++) {
-		struct page *p = page + i;
-
-		if (unlikely(check_new_page(p)))
-			return true;
-	}
-
-	return false;
-}
-
 inline void post_alloc_hook(struct page *page, unsigned int order,
 				gfp_t gfp_flags)
 {
@@ -2610,8 +2805,10 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			int migratetype, bool cold)
 {
 	int i, alloced = 0;
+	u64 start;
     /* 上层函数已经关了中断，这里需要操作管理区，获取管理区的自旋锁 */
 	spin_lock(&zone->lock);
+	start = pcp_latency_start();
 	/*
 	 * 遍历per-CPU缓存中的所有页，检查是否有指定迁移类型的页可用。
 	 * 如果前一次调用中，用不同迁移类型的页重新填充了缓存，就可能
@@ -2625,7 +2822,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 		if (unlikely(page == NULL))
 			break;
 
-		if (unlikely(check_pcp_refill(page)))
+		if (unlikely(check_pcp_refill(page, order)))
 			continue;
 
 		/*
@@ -2657,6 +2854,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	 */
 	 /* 递减管理区的空闲页面计数。 */
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
+	pcp_latency_lock_end(start);
 	/* 释放管理区的自旋锁 */
 	spin_unlock(&zone->lock);
 	return alloced;
@@ -2679,10 +2877,8 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	local_irq_save(flags);
 	batch = READ_ONCE(pcp->batch);
 	to_drain = min(pcp->count, batch);
-	if (to_drain > 0) {
+	if (to_drain > 0)
 		free_pcppages_bulk(zone, to_drain, pcp);
-		pcp->count -= to_drain;
-	}
 	local_irq_restore(flags);
 }
 #endif
@@ -2704,10 +2900,8 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 	pset = per_cpu_ptr(zone->pageset, cpu);
 
 	pcp = &pset->pcp;
-	if (pcp->count) {
+	if (pcp->count)
 		free_pcppages_bulk(zone, pcp->count, pcp);
-		pcp->count = 0;
-	}
 	local_irq_restore(flags);
 }
 
@@ -2839,17 +3033,19 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Free a page of order <= PAGE_ALLOC_COSTLY_ORDER to the pcp lists
  * cold == true ? free a cold page : free a hot page
  */
 /**
  * 将一个单页释放到冷热缓存池中
  */
-void free_hot_cold_page(struct page *page, bool cold)
+static void __free_hot_cold_page(struct page *page, unsigned int order,
+				 bool cold)
 {
     /* 获取页的内存域 */
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
+	struct list_head *list;
 	unsigned long flags;
 	unsigned long pfn = page_to_pfn(page);
 	int migratetype;
@@ -2858,7 +3054,7 @@ void free_hot_cold_page(struct page *page, bool cold)
               * free_pages_prepare主要是检查页面状态是否允许释放，避免错误的释放页面。
               * 并且处理一些调试相关的事务。
       */
-	if (!free_pcp_prepare(page))
+	if (!free_pcp_prepare(page, order))
 		return;
 
 	migratetype = get_pfnblock_migratetype(page, pfn);
@@ -2867,7 +3063,7 @@ void free_hot_cold_page(struct page *page, bool cold)
 	置本地IRQ标志位
 */
 	local_irq_save(flags);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -2884,7 +3080,7 @@ void free_hot_cold_page(struct page *page, bool cold)
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(is_migrate_isolate(migratetype))) {
 		/* 该页面是从邻近的CPU管理区中调配过来的，仍然放到MIGRATE_ISOLATE中，不转化为可迁移的页面 */
-			free_one_page(zone, page, pfn, 0, migratetype);
+			free_one_page(zone, page, pfn, order, migratetype);
 			goto out;
 		}
 		/* 如果是从保留的链表中分配的页面，也将其放入可移动页中 */
@@ -2893,13 +3089,14 @@ void free_hot_cold_page(struct page *page, bool cold)
 
 	/* 获得per-CPU缓存中的页 */
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[order_to_pindex(migratetype, order)];
 	if (!cold)/* 放入列表的首部，这样后续的分配过程可以利用CPU缓存中的热缓存 */
-		list_add(&page->lru, &pcp->lists[migratetype]);
+		list_add(&page->lru, list);
 	else/* 如果是冷页，则CPU缓存中还没有页面数据，将页面放入页面缓存链表的尾部。 */
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
+		list_add_tail(&page->lru, list);
 
 	 /* 当前CPU页面缓存计数 */
-	pcp->count++;
+	pcp->count += 1 << order;
 	/*
 	 * 如果per-CPU缓存中页的数目超出了pcp->high，则将数量为
 	 * pcp->batch的一批内存页还给伙伴系统。该策略称之为
@@ -2909,10 +3106,8 @@ void free_hot_cold_page(struct page *page, bool cold)
 	 */
 	if (pcp->count >= pcp->high) {
 		unsigned long batch = READ_ONCE(pcp->batch);
-        /* 将页面缓存中的页面释放一部分到伙伴系统中 */
+        /* 将页面缓存中的页面释放一部分到伙伴系统中，同时递减PCP中的缓存页面数量 */
 		free_pcppages_bulk(zone, batch, pcp);
-		/* 递减PCP中的缓存页面数量 */
-		pcp->count -= batch;
 	}
 
 out:
@@ -2920,6 +3115,15 @@ out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == true ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, bool cold)
+{
+	__free_hot_cold_page(page, 0, cold);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -3052,6 +3256,7 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 {
 	unsigned long flags;
 	struct page *page;
+	u64 start = pcp_latency_start();
     /*
 	只分配1页(order=0)的情况下,会判断是不是”冷”页
 	冷页的区别是会放到高速缓存的末尾,
@@ -3065,7 +3270,7 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	 * 伙伴系统直接取得，而是取自per-CPU的页缓存。
 	 */
 	/* 只分配一页，也许缓存中可以获得页面 */
-	if (likely(order == 0)) {
+	if (likely(pcp_allowed_order(order))) {
 		struct per_cpu_pages *pcp;
 		struct list_head *list;
 
@@ -3076,7 +3281,7 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 		    /* 取得本CPU的页面缓存对象 */
 			pcp = &this_cpu_ptr(zone->pageset)->pcp;
 			/* 根据用户指定的迁移类型，从指定的迁移缓存链表中分配 */
-			list = &pcp->lists[migratetype];
+			list = &pcp->lists[order_to_pindex(migratetype, order)];
 		/*
 		 * 如果缓存为空，内核可借机检查缓存填充水平
 		 */
@@ -3089,12 +3294,20 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 */
     /* 从伙伴系统中摘除一批页面到缓存中，补充的页面个数由每CPU缓存的batch字段指定 */
 
-				pcp->count += rmqueue_bulk(zone, 0,
-						pcp->batch, list,
-						migratetype, cold);
+				pcp->count += rmqueue_bulk(zone, order,
+						pcp_order_batch(pcp, order),
+						list, migratetype, cold) << order;
             /* 如果链表仍然为空，那么说明伙伴系统中页面也没有了，分配失败。 */
-				if (unlikely(list_empty(list)))
-					goto failed;
+				if (unlikely(list_empty(list))) {
+					if (!order)
+						goto failed;
+					/*
+					 * Let the buddy path below try the
+					 * highatomic reserves.
+					 */
+					local_irq_restore(flags);
+					goto buddy;
+				}
 			}
 
 		/*
@@ -3110,10 +3323,12 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 
         /* 将页面从每CPU缓存链表中取出，并将每CPU缓存计数减1 */
 			list_del(&page->lru);
-			pcp->count--;
+			pcp->count -= 1 << order;
 
-		} while (check_new_pcp(page));
+		} while (check_new_pcp(page, order));
 	} else {
+		u64 lock_start;
+buddy:
 		/*
 		 * 如果需要分配多页，内核调用__rmqueue()会从内存域的伙伴列表
 		 * 中选择适当的内存块。如有必要，该函数会自动分解大块内存，
@@ -3126,6 +3341,7 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 
 		/* 关中断，并获得管理区的锁 */
 		spin_lock_irqsave(&zone->lock, flags);
+		lock_start = pcp_latency_start();
 
 		/* 从伙伴系统中分配页面，可能会分裂大的内存块 */
 		do {
@@ -3139,6 +3355,7 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 			/* 调用__rmqueue从伙伴系统中分配页面 */
 				page = __rmqueue(zone, order, migratetype);
 		} while (page && check_new_pages(page, order));
+		pcp_latency_lock_end(lock_start);
 		/* 这里仅仅打开自旋锁，待后面统计计数设置完毕后再开中断 */
 		spin_unlock(&zone->lock);
 		/* 没有连续页了，失败 */
@@ -3154,6 +3371,7 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	zone_statistics(preferred_zone, zone);
 	/* 恢复中断 */
 	local_irq_restore(flags);
+	pcp_latency_alloc_end(start, order);
 
 	VM_BUG_ON_PAGE(bad_range(zone, page), page);
 	return page;
@@ -6159,14 +6377,14 @@ static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
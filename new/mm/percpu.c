@@ -35,11 +35,14 @@
  * area in the chunk.  This helps the allocator not to iterate the
  * chunk maps unnecessarily.
  *
- * Allocation state in each chunk is kept using an array of integers
- * on chunk->map.  A positive value in the map represents a free
- * region and negative allocated.  Allocation inside a chunk is done
- * by scanning this map sequentially and serving the first matching
- * entry.  This is mostly copied from the percpu_modalloc() allocator.
+ * Allocation state in each chunk is kept using a bitmap on
+ * chunk->alloc_map, one bit per PCPU_MIN_ALLOC_SIZE bytes, and a boundary
+ * bitmap on chunk->bound_map marking where each allocation starts and
+ * ends.  The bitmap is split into one block per page, and each block
+ * keeps hints about its largest free area and the free space along its
+ * edges in chunk->md_blocks.  Allocation walks the block hints to find a
+ * candidate offset and only then scans the bitmap, so the cost does not
+ * grow with the number of areas allocated in the chunk.
  * Chunks can be determined from the address using the index field
  * in the page struct. The index field contains a pointer to the chunk.
  *
@@ -102,12 +105,19 @@
 #include <asm/io.h>
 
 #define PCPU_SLOT_BASE_SHIFT		5	/* 1-31 shares the same slot */
-#define PCPU_DFL_MAP_ALLOC		16	/* start a map with 16 ents */
-#define PCPU_ATOMIC_MAP_MARGIN_LOW	32
-#define PCPU_ATOMIC_MAP_MARGIN_HIGH	64
 #define PCPU_EMPTY_POP_PAGES_LOW	2
 #define PCPU_EMPTY_POP_PAGES_HIGH	4
 
+/*
+ * Each bit of the allocation map covers PCPU_MIN_ALLOC_SIZE bytes, and the
+ * map is split into blocks of one page for the hint metadata.
+ */
+#define PCPU_MIN_ALLOC_SHIFT		2
+#define PCPU_MIN_ALLOC_SIZE		(1 << PCPU_MIN_ALLOC_SHIFT)
+#define PCPU_BITMAP_BLOCK_SIZE		PAGE_SIZE
+#define PCPU_BITMAP_BLOCK_BITS		(PCPU_BITMAP_BLOCK_SIZE >>	\
+					 PCPU_MIN_ALLOC_SHIFT)
+
 #ifdef CONFIG_SMP
 /* default addr <-> pcpu_ptr mapping, override in asm/percpu.h if necessary */
 #ifndef __addr_to_pcpu_ptr
@@ -128,6 +138,18 @@
 #define __pcpu_ptr_to_addr(ptr)		(void __force *)(ptr)
 #endif	/* CONFIG_SMP */
 
+/*
+ * Allocation hints of one block (page) of a chunk's allocation map.  All
+ * offsets and sizes are in bits and relative to the start of the block.
+ */
+struct pcpu_block_md {
+	int			contig_hint;	/* largest free area in block */
+	int			contig_hint_start; /* where contig_hint starts */
+	int			left_free;	/* free bits at the block start */
+	int			right_free;	/* free bits at the block end */
+	int			first_free;	/* first free bit in block */
+};
+
 /* 内核使用pcpu_chunk结构管理percpu内存 */
 struct pcpu_chunk {
 	/**
@@ -140,30 +162,20 @@ struct pcpu_chunk {
 	/* 该chunk所管理的副本空间中空闲空间大小 */
 	/* 该chunk中最大的可用空间的map项的size */
 	int			contig_hint;	/* max contiguous size hint */
+	int			contig_hint_start; /* bit offset of contig_hint */
 	/**
 	 * 副本空间首地址。副本空间也是由一个chunk来管，称之为first chunk中，
 	 * 副本空间中的dynamic空间用来给动态per-cpu变量使用. percpu内存开始基地值
 	 */
 	void			*base_addr;	/* base address of this chunk */
 
-	/* 为了对chunk所管理的副本空间分配情况的跟踪，用来表示可以管理的个数 */
-	int			map_used;	/* # of map entries used before the sentry */
-	/**
-	 * 已经分配的小块个数，因为每个分配的小块都是给动态per-cpu使用的，
-	 * 所以其实是已经分配的变量的个数. 记录map数组的项数，为PERCPU_DYNAMIC_EARLY_SLOTS=128
-	 */
-	int			map_alloc;	/* # of map entries allocated */
-	/* map数组，记录该chunk的空间使用情况. 正数表示该空间空闲，负数就已经分配给一个变量了 */
-	/*
-	 * 若map项>0,表示该map中记录的size是可以用来分配percpu空间的
-	 * 若map项<0,表示该map项中的size已经被分配使用
-	 */
-	int			*map;		/* allocation map */
-	struct list_head	map_extend_list;/* on pcpu_map_extend_chunks */
+	unsigned long		*alloc_map;	/* allocation map */
+	unsigned long		*bound_map;	/* boundary map */
+	struct pcpu_block_md	*md_blocks;	/* per-page allocation hints */
 
 	/* 指向分配的页数据 */
 	void			*data;		/* chunk data */
-	int			first_free;	/* no free below this */
+	int			first_bit;	/* no free below this */
 	bool			immutable;	/* no [de]population allowed */
 	int			nr_populated;	/* # of populated pages */
 	unsigned long		populated[];	/* populated bitmap */
@@ -210,13 +222,10 @@ static struct pcpu_chunk *pcpu_reserved_chunk;
 static int pcpu_reserved_chunk_limit;
 
 static DEFINE_SPINLOCK(pcpu_lock);	/* all internal data structures */
-static DEFINE_MUTEX(pcpu_alloc_mutex);	/* chunk create/destroy, [de]pop, map ext */
+static DEFINE_MUTEX(pcpu_alloc_mutex);	/* chunk create/destroy, [de]pop */
 
 static struct list_head *pcpu_slot __read_mostly; /* chunk list slots */
 
-/* chunks which need their map areas extended, protected by pcpu_lock */
-static LIST_HEAD(pcpu_map_extend_chunks);
-
 /*
  * The number of empty populated pages, protected by pcpu_lock.  The
  * reserved chunk doesn't contribute to the count.
@@ -375,36 +384,232 @@ static void pcpu_mem_free(void *ptr)
 	kvfree(ptr);
 }
 
+/* number of bits in the allocation map of a chunk */
+static int pcpu_nr_map_bits(void)
+{
+	return pcpu_unit_size >> PCPU_MIN_ALLOC_SHIFT;
+}
+
+static int pcpu_off_to_block_index(int off)
+{
+	return off / PCPU_BITMAP_BLOCK_BITS;
+}
+
+static int pcpu_off_to_block_off(int off)
+{
+	return off & (PCPU_BITMAP_BLOCK_BITS - 1);
+}
+
+static int pcpu_block_off_to_off(int index, int off)
+{
+	return index * PCPU_BITMAP_BLOCK_BITS + off;
+}
+
+/* the part of the allocation map covered by block @index */
+static unsigned long *pcpu_index_alloc_map(struct pcpu_chunk *chunk, int index)
+{
+	return chunk->alloc_map +
+		(index * PCPU_BITMAP_BLOCK_BITS / BITS_PER_LONG);
+}
+
+static bool pcpu_block_empty(struct pcpu_block_md *block)
+{
+	return block->contig_hint == PCPU_BITMAP_BLOCK_BITS;
+}
+
+/* set the hints of a block which is entirely free or entirely in use */
+static void pcpu_block_init(struct pcpu_block_md *block, bool free)
+{
+	int bits = free ? PCPU_BITMAP_BLOCK_BITS : 0;
+
+	block->contig_hint = bits;
+	block->contig_hint_start = 0;
+	block->left_free = bits;
+	block->right_free = bits;
+	block->first_free = free ? 0 : PCPU_BITMAP_BLOCK_BITS;
+}
+
+/**
+ * pcpu_block_update - update a block given a free area
+ * @block: block of interest
+ * @start: start offset in block
+ * @end: end offset in block
+ *
+ * [@start, @end) is expected to be a whole free area of the block.
+ */
+static void pcpu_block_update(struct pcpu_block_md *block, int start, int end)
+{
+	int contig = end - start;
+
+	block->first_free = min(block->first_free, start);
+	if (start == 0)
+		block->left_free = contig;
+
+	if (end == PCPU_BITMAP_BLOCK_BITS)
+		block->right_free = contig;
+
+	if (contig > block->contig_hint) {
+		block->contig_hint_start = start;
+		block->contig_hint = contig;
+	}
+}
+
+/**
+ * pcpu_block_refresh_hint - recompute the hints of a block
+ * @chunk: chunk of interest
+ * @index: index of the block
+ *
+ * Scan the block's part of the allocation map and rebuild its hints.
+ * This walks at most PCPU_BITMAP_BLOCK_BITS bits.
+ */
+static void pcpu_block_refresh_hint(struct pcpu_chunk *chunk, int index)
+{
+	struct pcpu_block_md *block = chunk->md_blocks + index;
+	unsigned long *alloc_map = pcpu_index_alloc_map(chunk, index);
+	int rs, re;
+
+	pcpu_block_init(block, false);
+
+	rs = find_next_zero_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS, 0);
+	while (rs < PCPU_BITMAP_BLOCK_BITS) {
+		re = find_next_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS, rs + 1);
+		pcpu_block_update(block, rs, re);
+		rs = find_next_zero_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS,
+					re + 1);
+	}
+}
+
+/**
+ * pcpu_block_update_hint - update block hints after an alloc or free
+ * @chunk: chunk of interest
+ * @bit_off: start of the area in bits
+ * @bits: size of the area in bits
+ * @alloc: whether the area was allocated or freed
+ *
+ * Blocks entirely covered by the area are set directly, only the blocks
+ * at its edges need to be rescanned.
+ *
+ * RETURNS:
+ * The number of pages which went from completely free to (partly) in use,
+ * or the other way around when freeing.
+ */
+static int pcpu_block_update_hint(struct pcpu_chunk *chunk, int bit_off,
+				  int bits, bool alloc)
+{
+	int s_index = pcpu_off_to_block_index(bit_off);
+	int e_index = pcpu_off_to_block_index(bit_off + bits - 1);
+	int i, nr_pages = 0;
+
+	for (i = s_index; i <= e_index; i++) {
+		struct pcpu_block_md *block = chunk->md_blocks + i;
+		int start = 0, end = PCPU_BITMAP_BLOCK_BITS;
+		bool was_empty = pcpu_block_empty(block);
+
+		if (i == s_index)
+			start = pcpu_off_to_block_off(bit_off);
+		if (i == e_index)
+			end = pcpu_off_to_block_off(bit_off + bits - 1) + 1;
+
+		if (start == 0 && end == PCPU_BITMAP_BLOCK_BITS)
+			pcpu_block_init(block, !alloc);
+		else
+			pcpu_block_refresh_hint(chunk, i);
+
+		if (was_empty != pcpu_block_empty(block))
+			nr_pages++;
+	}
+
+	return nr_pages;
+}
+
 /**
- * pcpu_count_occupied_pages - count the number of pages an area occupies
+ * pcpu_chunk_refresh_hint - recompute the contig hint of a chunk
  * @chunk: chunk of interest
- * @i: index of the area in question
  *
- * Count the number of pages chunk's @i'th area occupies.  When the area's
- * start and/or end address isn't aligned to page boundary, the straddled
- * page is included in the count iff the rest of the page is free.
+ * Combine the block hints into the largest free area of the chunk,
+ * joining the free edges of neighbouring blocks.  This looks at each
+ * block once and never at the allocation map itself.
  */
-static int pcpu_count_occupied_pages(struct pcpu_chunk *chunk, int i)
+static void pcpu_chunk_refresh_hint(struct pcpu_chunk *chunk)
 {
-	int off = chunk->map[i] & ~1;
-	int end = chunk->map[i + 1] & ~1;
+	struct pcpu_block_md *block = chunk->md_blocks;
+	int run = 0, run_start = 0, best = 0, best_start = 0;
+	int i;
+
+	for (i = 0; i < pcpu_unit_pages; i++, block++) {
+		if (pcpu_block_empty(block)) {
+			if (!run)
+				run_start = pcpu_block_off_to_off(i, 0);
+			run += PCPU_BITMAP_BLOCK_BITS;
+			continue;
+		}
 
-	if (!PAGE_ALIGNED(off) && i > 0) {
-		int prev = chunk->map[i - 1];
+		/* a free run ending in the left edge of this block */
+		if (run + block->left_free > best) {
+			best = run + block->left_free;
+			best_start = run ? run_start : pcpu_block_off_to_off(i, 0);
+		}
+
+		if (block->contig_hint > best) {
+			best = block->contig_hint;
+			best_start = pcpu_block_off_to_off(i,
+						block->contig_hint_start);
+		}
+
+		run = block->right_free;
+		run_start = pcpu_block_off_to_off(i + 1, 0) - run;
+	}
 
-		if (!(prev & 1) && prev <= round_down(off, PAGE_SIZE))
-			off = round_down(off, PAGE_SIZE);
+	if (run > best) {
+		best = run;
+		best_start = run_start;
 	}
 
-	if (!PAGE_ALIGNED(end) && i + 1 < chunk->map_used) {
-		int next = chunk->map[i + 1];
-		int nend = chunk->map[i + 2] & ~1;
+	chunk->contig_hint = best << PCPU_MIN_ALLOC_SHIFT;
+	chunk->contig_hint_start = best_start;
+}
 
-		if (!(next & 1) && nend >= round_up(end, PAGE_SIZE))
-			end = round_up(end, PAGE_SIZE);
+/**
+ * pcpu_chunk_update_free - update the contig hint of a chunk after a free
+ * @chunk: chunk of interest
+ * @bit_off: start of the freed area in bits
+ * @bits: size of the freed area in bits
+ *
+ * A free never makes any free area smaller, so the only new candidate
+ * for the contig hint is the free area the freed bits merged into.  Only
+ * the allocation map around it is looked at, not every block.
+ */
+static void pcpu_chunk_update_free(struct pcpu_chunk *chunk, int bit_off,
+				   int bits)
+{
+	int start, end;
+
+	start = find_last_bit(chunk->alloc_map, bit_off);
+	start = start < bit_off ? start + 1 : 0;
+	end = find_next_bit(chunk->alloc_map, pcpu_nr_map_bits(),
+			    bit_off + bits);
+
+	if ((end - start) << PCPU_MIN_ALLOC_SHIFT > chunk->contig_hint) {
+		chunk->contig_hint = (end - start) << PCPU_MIN_ALLOC_SHIFT;
+		chunk->contig_hint_start = start;
 	}
+}
 
-	return max_t(int, PFN_DOWN(end) - PFN_UP(off), 0);
+/* set up the maps and hints of a chunk with nothing allocated */
+static void pcpu_init_chunk_maps(struct pcpu_chunk *chunk)
+{
+	int i;
+
+	for (i = 0; i < pcpu_unit_pages; i++)
+		pcpu_block_init(chunk->md_blocks + i, true);
+
+	/* the end of the map bounds the last area */
+	set_bit(pcpu_nr_map_bits(), chunk->bound_map);
+
+	chunk->free_size = pcpu_unit_size;
+	chunk->contig_hint = pcpu_unit_size;
+	chunk->contig_hint_start = 0;
+	chunk->first_bit = 0;
 }
 
 /**
@@ -435,176 +640,202 @@ static void pcpu_chunk_relocate(struct pcpu_chunk *chunk, int oslot)
 }
 
 /**
- * pcpu_need_to_extend - determine whether chunk area map needs to be extended
+ * pcpu_next_fit_region - find the next free region that fits an allocation
  * @chunk: chunk of interest
- * @is_atomic: the allocation context
- *
- * Determine whether area map of @chunk needs to be extended.  If
- * @is_atomic, only the amount necessary for a new allocation is
- * considered; however, async extension is scheduled if the left amount is
- * low.  If !@is_atomic, it aims for more empty space.  Combined, this
- * ensures that the map is likely to have enough available space to
- * accomodate atomic allocations which can't extend maps directly.
- *
- * CONTEXT:
- * pcpu_lock.
- *
- * RETURNS:
- * New target map allocation length if extension is necessary, 0
- * otherwise.
+ * @alloc_bits: size of the allocation in bits
+ * @align: alignment of the allocation in bits
+ * @bit_off: chunk offset to start from, updated to the region found
+ * @bits: updated to the size of the region found
+ *
+ * Walk the block hints starting at @bit_off looking for a region of at
+ * least @alloc_bits free bits, either the contig hint of a block or a
+ * free run spanning block boundaries.  If nothing fits, @bit_off is set
+ * past the end of the chunk.
  */
-/*检查chunk的map数组是否需要扩展*/
-static int pcpu_need_to_extend(struct pcpu_chunk *chunk, bool is_atomic)
+static void pcpu_next_fit_region(struct pcpu_chunk *chunk, int alloc_bits,
+				 int align, int *bit_off, int *bits)
 {
-	int margin, new_alloc;
-
-	lockdep_assert_held(&pcpu_lock);
-
-	if (is_atomic) {
-		margin = 3;
+	int i = pcpu_off_to_block_index(*bit_off);
+	int block_off = pcpu_off_to_block_off(*bit_off);
+	struct pcpu_block_md *block;
+
+	*bits = 0;
+	for (block = chunk->md_blocks + i; i < pcpu_unit_pages; block++, i++) {
+		/* handles contig area across blocks */
+		if (*bits) {
+			*bits += block->left_free;
+			if (*bits >= alloc_bits)
+				return;
+			if (block->left_free == PCPU_BITMAP_BLOCK_BITS)
+				continue;
+		}
 
-		if (chunk->map_alloc <
-		    chunk->map_used + PCPU_ATOMIC_MAP_MARGIN_LOW) {
-			if (list_empty(&chunk->map_extend_list)) {
-				list_add_tail(&chunk->map_extend_list,
-					      &pcpu_map_extend_chunks);
-				pcpu_schedule_balance_work();
-			}
+		/* check block->contig_hint */
+		*bits = ALIGN(block->contig_hint_start, align) -
+			block->contig_hint_start;
+		/*
+		 * The block offset tells whether this block was already
+		 * looked at by a prior iteration.
+		 */
+		if (block->contig_hint &&
+		    block->contig_hint_start >= block_off &&
+		    block->contig_hint >= *bits + alloc_bits) {
+			*bits += alloc_bits + block->contig_hint_start -
+				 block->first_free;
+			*bit_off = pcpu_block_off_to_off(i, block->first_free);
+			return;
 		}
-	} else {
-		margin = PCPU_ATOMIC_MAP_MARGIN_HIGH;
+		/* reset to satisfy the second predicate above */
+		block_off = 0;
+
+		*bit_off = ALIGN(PCPU_BITMAP_BLOCK_BITS - block->right_free,
+				 align);
+		*bits = PCPU_BITMAP_BLOCK_BITS - *bit_off;
+		*bit_off = pcpu_block_off_to_off(i, *bit_off);
+		if (*bits >= alloc_bits)
+			return;
 	}
 
-	/*map_alloc默认设置为128，只有map_used记录超过126时才会进行map数组扩展*/
-	if (chunk->map_alloc >= chunk->map_used + margin)
-		return 0;
-
-	new_alloc = PCPU_DFL_MAP_ALLOC;
-	/*计算该chunk的map数组新的大小，并返回*/
-	while (new_alloc < chunk->map_used + margin)
-		new_alloc *= 2;
-
-	return new_alloc;
+	/* no valid offsets were found - fail condition */
+	*bit_off = pcpu_nr_map_bits();
 }
 
+#define pcpu_for_each_fit_region(chunk, alloc_bits, align, bit_off, bits)  \
+	for (pcpu_next_fit_region((chunk), (alloc_bits), (align), &(bit_off), \
+				  &(bits));					\
+	     (bit_off) < pcpu_nr_map_bits();				\
+	     (bit_off) += (bits),					\
+	     pcpu_next_fit_region((chunk), (alloc_bits), (align), &(bit_off), \
+				  &(bits)))
+
 /**
- * pcpu_extend_area_map - extend area map of a chunk
+ * pcpu_is_populated - determine if the region is populated
  * @chunk: chunk of interest
- * @new_alloc: new target allocation length of the area map
+ * @bit_off: chunk offset
+ * @bits: size of area
+ * @next_off: return value for the next offset to start searching
  *
- * Extend area map of @chunk to have @new_alloc entries.
- *
- * CONTEXT:
- * Does GFP_KERNEL allocation.  Grabs and releases pcpu_lock.
+ * For atomic allocations, check if the backing pages are populated.
  *
  * RETURNS:
- * 0 on success, -errno on failure.
+ * %true if the backing pages are populated, otherwise %false with
+ * @next_off set past the first unpopulated region.
  */
-/*对map数组的大小进行扩展*/
-static int pcpu_extend_area_map(struct pcpu_chunk *chunk, int new_alloc)
+static bool pcpu_is_populated(struct pcpu_chunk *chunk, int bit_off, int bits,
+			      int *next_off)
 {
-	int *old = NULL, *new = NULL;
-	size_t old_size = 0, new_size = new_alloc * sizeof(new[0]);
-	unsigned long flags;
+	int page_start, page_end, rs, re;
 
-	lockdep_assert_held(&pcpu_alloc_mutex);
-	/*为新的map数组大小分配内存空间*/
-	new = pcpu_mem_zalloc(new_size);
-	if (!new)
-		return -ENOMEM;
+	page_start = PFN_DOWN(bit_off * PCPU_MIN_ALLOC_SIZE);
+	page_end = PFN_UP((bit_off + bits) * PCPU_MIN_ALLOC_SIZE);
 
-	/* acquire pcpu_lock and switch to new area map */
-	spin_lock_irqsave(&pcpu_lock, flags);
-
-	if (new_alloc <= chunk->map_alloc)
-		goto out_unlock;
-
-	old_size = chunk->map_alloc * sizeof(chunk->map[0]);
-	old = chunk->map;
-
-	/*复制老的map数组信息到new*/
-	memcpy(new, old, old_size);
+	rs = page_start;
+	pcpu_next_unpop(chunk, &rs, &re, page_end);
+	if (rs >= page_end)
+		return true;
 
-	/*重新设置map数组，完成map数组的扩展*/
-	chunk->map_alloc = new_alloc;
-	chunk->map = new;
-	new = NULL;
+	*next_off = re * PAGE_SIZE / PCPU_MIN_ALLOC_SIZE;
+	return false;
+}
 
-out_unlock:
-	spin_unlock_irqrestore(&pcpu_lock, flags);
+/**
+ * pcpu_find_block_fit - find the block index to start searching
+ * @chunk: chunk of interest
+ * @alloc_bits: size of request in allocation units
+ * @align: alignment of area (max PAGE_SIZE bytes)
+ * @pop_only: use populated regions only
+ *
+ * Given a chunk and an allocation spec, find the offset to begin searching
+ * for a free region.  This uses the block hints to skip over blocks that
+ * cannot serve the request.
+ *
+ * CONTEXT:
+ * pcpu_lock.
+ *
+ * RETURNS:
+ * The offset in the bitmap to begin searching, -1 if no offset is found.
+ */
+static int pcpu_find_block_fit(struct pcpu_chunk *chunk, int alloc_bits,
+			       int align, bool pop_only)
+{
+	int bit_off, bits;
 
 	/*
-	 * pcpu_mem_free() might end up calling vfree() which uses
-	 * IRQ-unsafe lock and thus can't be called under pcpu_lock.
+	 * Check to see if the allocation can fit in the chunk's contig hint.
+	 * If it cannot, there is no point in walking the blocks.
 	 */
-	pcpu_mem_free(old);
-	pcpu_mem_free(new);
+	bit_off = ALIGN(chunk->contig_hint_start, align) -
+		  chunk->contig_hint_start;
+	if (bit_off + alloc_bits >
+	    (chunk->contig_hint >> PCPU_MIN_ALLOC_SHIFT))
+		return -1;
+
+	bit_off = chunk->first_bit;
+	bits = 0;
+	pcpu_for_each_fit_region(chunk, alloc_bits, align, bit_off, bits) {
+		if (!pop_only || pcpu_is_populated(chunk, bit_off, bits,
+						   &bit_off))
+			break;
 
-	return 0;
+		bits = 0;
+	}
+
+	if (bit_off >= pcpu_nr_map_bits())
+		return -1;
+
+	return bit_off;
 }
 
 /**
- * pcpu_fit_in_area - try to fit the requested allocation in a candidate area
- * @chunk: chunk the candidate area belongs to
- * @off: the offset to the start of the candidate area
- * @this_size: the size of the candidate area
- * @size: the size of the target allocation
- * @align: the alignment of the target allocation
- * @pop_only: only allocate from already populated region
- *
- * We're trying to allocate @size bytes aligned at @align.  @chunk's area
- * at @off sized @this_size is a candidate.  This function determines
- * whether the target allocation fits in the candidate area and returns the
- * number of bytes to pad after @off.  If the target area doesn't fit, -1
- * is returned.
- *
- * If @pop_only is %true, this function only considers the already
- * populated part of the candidate area.
+ * pcpu_mark_area - mark an area of a chunk as allocated
+ * @chunk: chunk of interest
+ * @bit_off: start of the area in bits
+ * @bits: size of the area in bits
+ *
+ * Update the allocation and boundary maps and all the hints.
+ *
+ * RETURNS:
+ * The number of pages which were empty and are now (partly) in use.
  */
-static int pcpu_fit_in_area(struct pcpu_chunk *chunk, int off, int this_size,
-			    int size, int align, bool pop_only)
+static int pcpu_mark_area(struct pcpu_chunk *chunk, int bit_off, int bits)
 {
-	int cand_off = off;
+	int contig_bits = chunk->contig_hint >> PCPU_MIN_ALLOC_SHIFT;
+	int occ_pages;
 
-	while (true) {
-		int head = ALIGN(cand_off, align) - off;
-		int page_start, page_end, rs, re;
+	bitmap_set(chunk->alloc_map, bit_off, bits);
 
-		if (this_size < head + size)
-			return -1;
+	set_bit(bit_off, chunk->bound_map);
+	bitmap_clear(chunk->bound_map, bit_off + 1, bits - 1);
+	set_bit(bit_off + bits, chunk->bound_map);
 
-		if (!pop_only)
-			return head;
+	chunk->free_size -= bits * PCPU_MIN_ALLOC_SIZE;
 
-		/*
-		 * If the first unpopulated page is beyond the end of the
-		 * allocation, the whole allocation is populated;
-		 * otherwise, retry from the end of the unpopulated area.
-		 */
-		page_start = PFN_DOWN(head + off);
-		page_end = PFN_UP(head + off + size);
-
-		rs = page_start;
-		pcpu_next_unpop(chunk, &rs, &re, PFN_UP(off + this_size));
-		if (rs >= page_end)
-			return head;
-		cand_off = re * PAGE_SIZE;
-	}
+	if (bit_off == chunk->first_bit)
+		chunk->first_bit = find_next_zero_bit(chunk->alloc_map,
+						      pcpu_nr_map_bits(),
+						      bit_off + bits);
+
+	occ_pages = pcpu_block_update_hint(chunk, bit_off, bits, true);
+
+	/* only an area overlapping the largest free one can shrink it */
+	if (bit_off < chunk->contig_hint_start + contig_bits &&
+	    bit_off + bits > chunk->contig_hint_start)
+		pcpu_chunk_refresh_hint(chunk);
+
+	return occ_pages;
 }
 
 /**
  * pcpu_alloc_area - allocate area from a pcpu_chunk
  * @chunk: chunk of interest
- * @size: wanted size in bytes
- * @align: wanted align
- * @pop_only: allocate only from the populated area
+ * @alloc_bits: size of request in allocation units
+ * @align: alignment of area in allocation units
+ * @start: bit_off to start searching, from pcpu_find_block_fit()
  * @occ_pages_p: out param for the number of pages the area occupies
  *
- * Try to allocate @size bytes area aligned at @align from @chunk.
- * Note that this function only allocates the offset.  It doesn't
- * populate or map the area.
- *
- * @chunk->map must have at least two free slots.
+ * Try to allocate @alloc_bits aligned at @align from @chunk, searching
+ * the allocation map from @start.  Note that this function only
+ * allocates the offset.  It doesn't populate or map the area.
  *
  * CONTEXT:
  * pcpu_lock.
@@ -613,230 +844,118 @@ static int pcpu_fit_in_area(struct pcpu_chunk *chunk, int off, int this_size,
  * Allocated offset in @chunk on success, -1 if no matching area is
  * found.
  */
-/*从chunk的map数组中分配size大小空间，返回该size的偏移值*/
-static int pcpu_alloc_area(struct pcpu_chunk *chunk, int size, int align,
-			   bool pop_only, int *occ_pages_p)
+/*从chunk的位图中分配alloc_bits大小空间，返回该空间的偏移值*/
+static int pcpu_alloc_area(struct pcpu_chunk *chunk, int alloc_bits,
+			   int align, int start, int *occ_pages_p)
 {
+	unsigned long align_mask = align - 1;
 	int oslot = pcpu_chunk_slot(chunk);
-	int max_contig = 0;
-	int i, off;
-	bool seen_free = false;
-	int *p;
-
-	/*遍历该chunk的map中记录的空间，map中负数为已经使用的空间，正数为可以分配使用的空间*/
-	for (i = chunk->first_free, p = chunk->map + i; i < chunk->map_used; i++, p++) {
-		int head, tail;
-		int this_size;
-
-		off = *p;
-		if (off & 1)
-			continue;
+	int bit_off, end;
 
-		this_size = (p[1] & ~1) - off;
-
-		head = pcpu_fit_in_area(chunk, off, this_size, size, align,
-					pop_only);
-		/*若map中的空间大小小于要分配的空间大小，继续下一个*/
-		if (head < 0) {
-			if (!seen_free) {
-				chunk->first_free = i;
-				seen_free = true;
-			}
-			/*更新该chunk中可使用的空间大小*/
-			max_contig = max(this_size, max_contig);
-			continue;
-		}
-
-		/*
-		 * If head is small or the previous block is free,
-		 * merge'em.  Note that 'small' is defined as smaller
-		 * than sizeof(int), which is very small but isn't too
-		 * uncommon for percpu allocations.
-		 */
-		/*
-		 *如果head不为0，并且head很小(小于sizeof(int))，或者前一个map的可用空间大于0(但是p[i - 1] < head+size)
-		 *如果前一个map项>0，则将head合并到前一个map中
-		 *如果前一个map项<0,则将head合并到前一个map，并且是负数，不可用空间，当前chunk空闲size减去这head大小的空间
-		 */
-		if (head && (head < sizeof(int) || !(p[-1] & 1))) {
-			*p = off += head;
-			if (p[-1] & 1)
-				chunk->free_size -= head;
-			else
-				max_contig = max(*p - p[-1], max_contig);
-			this_size -= head;
-			head = 0;
-		}
-
-		/* if tail is small, just keep it around */
-		/*计算要分配空间的尾部*/
-		tail = this_size - head - size;
-		if (tail < sizeof(int)) {
-			tail = 0;
-			size = this_size - head;
-		}
-
-		/* split if warranted */
-		/*如果head不为0，或者tail不为0，则要将当前map分割*/
-		if (head || tail) {
-			int nr_extra = !!head + !!tail;
-
-			/* insert new subblocks */
-			memmove(p + nr_extra + 1, p + 1,
-				sizeof(chunk->map[0]) * (chunk->map_used - i));
-			chunk->map_used += nr_extra;
-
-			/*
-			 *如果head不为0，tail不为0，经过split之后，map[i]记录head，
-			 *map[i+1]记录要分配的size，map[i+2]记录tail
-			 */
-			if (head) {
-				if (!seen_free) {
-					chunk->first_free = i;
-					seen_free = true;
-				}
-				/*偏移要加上head，表示从head之后开始*/
-				*++p = off += head;
-				/*移到记录要分配size空间的map项*/
-				++i;
-				/*与max_contig比较大小，为下边更新chunk的最大空闲空间*/
-				max_contig = max(head, max_contig);
-			}
-			/*比较与max_contig的大小，为下边更新chunk的最大空闲空间*/
-			if (tail) {
-				p[1] = off + size;
-				max_contig = max(tail, max_contig);
-			}
-		}
+	lockdep_assert_held(&pcpu_lock);
 
-		if (!seen_free)
-			chunk->first_free = i + 1;
+	/*
+	 * The region found by pcpu_find_block_fit() may need to be
+	 * aligned, but never extends beyond the following block.
+	 */
+	end = min(start + alloc_bits + PCPU_BITMAP_BLOCK_BITS,
+		  pcpu_nr_map_bits());
+	bit_off = bitmap_find_next_zero_area(chunk->alloc_map, end, start,
+					     alloc_bits, align_mask);
+	if (bit_off >= end)
+		return -1;
 
-		/* update hint and mark allocated */
-		/*更新chunk的最大空闲空间*/
-		if (i + 1 == chunk->map_used)
-			chunk->contig_hint = max_contig; /* fully scanned */
-		else
-			chunk->contig_hint = max(chunk->contig_hint,
-						 max_contig);
-
-		/*chunk中的空闲空间大小递减*/
-		chunk->free_size -= size;
-		/*表示该map中的size大小已分配*/
-		*p |= 1;
-
-		*occ_pages_p = pcpu_count_occupied_pages(chunk, i);
-		/*重新计算chunk在slot中的位置*/
-		pcpu_chunk_relocate(chunk, oslot);
-		return off;
-	}
+	*occ_pages_p = pcpu_mark_area(chunk, bit_off, alloc_bits);
 
-	chunk->contig_hint = max_contig;	/* fully scanned */
+	/*重新计算chunk在slot中的位置*/
 	pcpu_chunk_relocate(chunk, oslot);
-
-	/* tell the upper layer that this chunk has no matching area */
-	return -1;
+	return bit_off * PCPU_MIN_ALLOC_SIZE;
 }
 
 /**
  * pcpu_free_area - free area to a pcpu_chunk
  * @chunk: chunk of interest
- * @freeme: offset of area to free
+ * @off: offset of area to free
  * @occ_pages_p: out param for the number of pages the area occupies
  *
- * Free area starting from @freeme to @chunk.  Note that this function
- * only modifies the allocation map.  It doesn't depopulate or unmap
- * the area.
+ * Free area starting from @off to @chunk.  The end of the area is found
+ * with the boundary map.  Note that this function only modifies the
+ * allocation map.  It doesn't depopulate or unmap the area.
  *
  * CONTEXT:
  * pcpu_lock.
  */
-static void pcpu_free_area(struct pcpu_chunk *chunk, int freeme,
+static void pcpu_free_area(struct pcpu_chunk *chunk, int off,
 			   int *occ_pages_p)
 {
 	int oslot = pcpu_chunk_slot(chunk);
-	int off = 0;
-	unsigned i, j;
-	int to_free = 0;
-	int *p;
-
-	freeme |= 1;	/* we are searching for <given offset, in use> pair */
-
-	i = 0;
-	j = chunk->map_used;
-	while (i != j) {
-		unsigned k = (i + j) / 2;
-		off = chunk->map[k];
-		if (off < freeme)
-			i = k + 1;
-		else if (off > freeme)
-			j = k;
-		else
-			i = j = k;
-	}
-	BUG_ON(off != freeme);
+	int bit_off, bits, end;
 
-	if (i < chunk->first_free)
-		chunk->first_free = i;
+	lockdep_assert_held(&pcpu_lock);
 
-	p = chunk->map + i;
-	*p = off &= ~1;
-	chunk->free_size += (p[1] & ~1) - off;
+	bit_off = off / PCPU_MIN_ALLOC_SIZE;
+	BUG_ON(!test_bit(bit_off, chunk->bound_map) ||
+	       !test_bit(bit_off, chunk->alloc_map));
 
-	*occ_pages_p = pcpu_count_occupied_pages(chunk, i);
+	/* find end index */
+	end = find_next_bit(chunk->bound_map, pcpu_nr_map_bits(),
+			    bit_off + 1);
+	bits = end - bit_off;
+	bitmap_clear(chunk->alloc_map, bit_off, bits);
 
-	/* merge with next? */
-	if (!(p[1] & 1))
-		to_free++;
-	/* merge with previous? */
-	if (i > 0 && !(p[-1] & 1)) {
-		to_free++;
-		i--;
-		p--;
-	}
-	if (to_free) {
-		chunk->map_used -= to_free;
-		memmove(p + 1, p + 1 + to_free,
-			(chunk->map_used - i) * sizeof(chunk->map[0]));
-	}
+	chunk->free_size += bits * PCPU_MIN_ALLOC_SIZE;
+	chunk->first_bit = min(chunk->first_bit, bit_off);
 
-	chunk->contig_hint = max(chunk->map[i + 1] - chunk->map[i] - 1, chunk->contig_hint);
+	*occ_pages_p = pcpu_block_update_hint(chunk, bit_off, bits, false);
+	pcpu_chunk_update_free(chunk, bit_off, bits);
 	pcpu_chunk_relocate(chunk, oslot);
 }
 
 static struct pcpu_chunk *pcpu_alloc_chunk(void)
 {
 	struct pcpu_chunk *chunk;
+	int map_bits = pcpu_nr_map_bits();
 
 	chunk = pcpu_mem_zalloc(pcpu_chunk_struct_size);
 	if (!chunk)
 		return NULL;
 
-	chunk->map = pcpu_mem_zalloc(PCPU_DFL_MAP_ALLOC *
-						sizeof(chunk->map[0]));
-	if (!chunk->map) {
-		pcpu_mem_free(chunk);
-		return NULL;
-	}
+	chunk->alloc_map = pcpu_mem_zalloc(BITS_TO_LONGS(map_bits) *
+					   sizeof(chunk->alloc_map[0]));
+	if (!chunk->alloc_map)
+		goto alloc_map_fail;
 
-	chunk->map_alloc = PCPU_DFL_MAP_ALLOC;
-	chunk->map[0] = 0;
-	chunk->map[1] = pcpu_unit_size | 1;
-	chunk->map_used = 1;
+	chunk->bound_map = pcpu_mem_zalloc(BITS_TO_LONGS(map_bits + 1) *
+					   sizeof(chunk->bound_map[0]));
+	if (!chunk->bound_map)
+		goto bound_map_fail;
+
+	chunk->md_blocks = pcpu_mem_zalloc(pcpu_unit_pages *
+					   sizeof(chunk->md_blocks[0]));
+	if (!chunk->md_blocks)
+		goto md_blocks_fail;
 
 	INIT_LIST_HEAD(&chunk->list);
-	INIT_LIST_HEAD(&chunk->map_extend_list);
-	chunk->free_size = pcpu_unit_size;
-	chunk->contig_hint = pcpu_unit_size;
+	pcpu_init_chunk_maps(chunk);
 
 	return chunk;
+
+md_blocks_fail:
+	pcpu_mem_free(chunk->bound_map);
+bound_map_fail:
+	pcpu_mem_free(chunk->alloc_map);
+alloc_map_fail:
+	pcpu_mem_free(chunk);
+	return NULL;
 }
 
 static void pcpu_free_chunk(struct pcpu_chunk *chunk)
 {
 	if (!chunk)
 		return;
-	pcpu_mem_free(chunk->map);
+	pcpu_mem_free(chunk->md_blocks);
+	pcpu_mem_free(chunk->bound_map);
+	pcpu_mem_free(chunk->alloc_map);
 	pcpu_mem_free(chunk);
 }
 
@@ -962,18 +1081,21 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	const char *err;
 	bool is_atomic = (gfp & GFP_KERNEL) != GFP_KERNEL;
 	int occ_pages = 0;
-	int slot, off, new_alloc, cpu, ret;
+	int slot, off, cpu, ret;
+	int bits, bit_align;
 	unsigned long flags;
 	void __percpu *ptr;
 
 	/*
-	 * We want the lowest bit of offset available for in-use/free
-	 * indicator, so force >= 16bit alignment and make size even.
+	 * The allocation map works in PCPU_MIN_ALLOC_SIZE units, so the
+	 * alignment must be at least that and the size is rounded up to it.
 	 */
-	if (unlikely(align < 2))
-		align = 2;
+	if (unlikely(align < PCPU_MIN_ALLOC_SIZE))
+		align = PCPU_MIN_ALLOC_SIZE;
 
-	size = ALIGN(size, 2);
+	size = ALIGN(size, PCPU_MIN_ALLOC_SIZE);
+	bits = size >> PCPU_MIN_ALLOC_SHIFT;
+	bit_align = align >> PCPU_MIN_ALLOC_SHIFT;
 
 	if (unlikely(!size || size > PCPU_MIN_UNIT_SIZE || align > PAGE_SIZE ||
 		     !is_power_of_2(align))) {
@@ -999,24 +1121,17 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 			goto fail_unlock;
 		}
 
-		/*检查是否要扩展chunk的的map数组，map数组默认设置为128项*/
-		while ((new_alloc = pcpu_need_to_extend(chunk, is_atomic))) {
-			spin_unlock_irqrestore(&pcpu_lock, flags);
-			/*对map数组进行扩展*/
-			if (is_atomic ||
-			    pcpu_extend_area_map(chunk, new_alloc) < 0) {
-				err = "failed to extend area map of reserved chunk";
-				goto fail;
-			}
-			spin_lock_irqsave(&pcpu_lock, flags);
+		off = pcpu_find_block_fit(chunk, bits, bit_align, is_atomic);
+		if (off < 0) {
+			err = "alloc from reserved chunk failed";
+			goto fail_unlock;
 		}
 
 		/*
 		 *从该chunk分配出size大小的空间，返回该size空间在chunk中的
 		 *偏移量off, 然后重新将该chunk挂到slot数组对应链表中
 		 */
-		off = pcpu_alloc_area(chunk, size, align, is_atomic,
-				      &occ_pages);
+		off = pcpu_alloc_area(chunk, bits, bit_align, off, &occ_pages);
 		if (off >= 0)
 			goto area_found;
 
@@ -1030,37 +1145,16 @@ restart:
 	for (slot = pcpu_size_to_slot(size); slot < pcpu_nr_slots; slot++) {
 		list_for_each_entry(chunk, &pcpu_slot[slot], list) {
 			/*在该链表中进一步寻找符合尺寸要求的chunk*/
-			if (size > chunk->contig_hint)
+			off = pcpu_find_block_fit(chunk, bits, bit_align,
+						  is_atomic);
+			if (off < 0)
 				continue;
 
-			/*
-			 *chunck用数组map记录每次分配的内存块，若该数组项数用完(默认为128项)，
-			 *但是若该chunk仍然还有空闲空间可分配，则需要增长该map数组项数来记录可分配的空间
-			 */
-			new_alloc = pcpu_need_to_extend(chunk, is_atomic);
-			if (new_alloc) {
-				if (is_atomic)
-					continue;
-				spin_unlock_irqrestore(&pcpu_lock, flags);
-				/*扩展map数组*/
-				if (pcpu_extend_area_map(chunk,
-							 new_alloc) < 0) {
-					err = "failed to extend area map";
-					goto fail;
-				}
-				spin_lock_irqsave(&pcpu_lock, flags);
-				/*
-				 * pcpu_lock has been dropped, need to
-				 * restart cpu_slot list walking.
-				 */
-				goto restart;
-			}
-
 			/*
 			 *从该chunk分配出size大小的空间，返回该size空间在chunk中的
 			 *偏移量off,然后重新将该chunk挂到slot数组对应链表中
 			 */
-			off = pcpu_alloc_area(chunk, size, align, is_atomic,
+			off = pcpu_alloc_area(chunk, bits, bit_align, off,
 					      &occ_pages);
 			if (off >= 0)
 				goto area_found;
@@ -1249,7 +1343,6 @@ static void pcpu_balance_workfn(struct work_struct *work)
 		if (chunk == list_first_entry(free_head, struct pcpu_chunk, list))
 			continue;
 
-		list_del_init(&chunk->map_extend_list);
 		list_move(&chunk->list, &to_free);
 	}
 
@@ -1267,25 +1360,6 @@ static void pcpu_balance_workfn(struct work_struct *work)
 		pcpu_destroy_chunk(chunk);
 	}
 
-	/* service chunks which requested async area map extension */
-	do {
-		int new_alloc = 0;
-
-		spin_lock_irq(&pcpu_lock);
-
-		chunk = list_first_entry_or_null(&pcpu_map_extend_chunks,
-					struct pcpu_chunk, map_extend_list);
-		if (chunk) {
-			list_del_init(&chunk->map_extend_list);
-			new_alloc = pcpu_need_to_extend(chunk, false);
-		}
-
-		spin_unlock_irq(&pcpu_lock);
-
-		if (new_alloc)
-			pcpu_extend_area_map(chunk, new_alloc);
-	} while (chunk);
-
 	/*
 	 * Ensure there are certain number of free populated pages for
 	 * atomic allocs.  Fill up from the most packed so that atomic
@@ -1614,6 +1688,50 @@ static void pcpu_dump_alloc_info(const char *lvl,
 	pr_cont("\n");
 }
 
+/**
+ * pcpu_alloc_first_chunk - create a chunk serving part of the first chunk
+ * @base_addr: mapped address of the first chunk
+ * @start: offset of the area to serve
+ * @size: size of the area to serve
+ *
+ * The maps are allocated from memblock as slab is not up yet.  Everything
+ * outside [@start, @start + @size) is marked allocated so that it is never
+ * handed out; it is not freed either.
+ */
+static struct pcpu_chunk * __init pcpu_alloc_first_chunk(void *base_addr,
+							 int start, int size)
+{
+	struct pcpu_chunk *chunk;
+	int map_bits = pcpu_nr_map_bits();
+	int start_bit = DIV_ROUND_UP(start, PCPU_MIN_ALLOC_SIZE);
+	int end_bit = (start + size) / PCPU_MIN_ALLOC_SIZE;
+
+	chunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
+	chunk->alloc_map = memblock_virt_alloc(BITS_TO_LONGS(map_bits) *
+					       sizeof(chunk->alloc_map[0]), 0);
+	chunk->bound_map = memblock_virt_alloc(BITS_TO_LONGS(map_bits + 1) *
+					       sizeof(chunk->bound_map[0]), 0);
+	chunk->md_blocks = memblock_virt_alloc(pcpu_unit_pages *
+					       sizeof(chunk->md_blocks[0]), 0);
+	INIT_LIST_HEAD(&chunk->list);
+	/*整个系统中percpu内存的起始地址*/
+	chunk->base_addr = base_addr;
+	chunk->immutable = true;
+	/*物理内存已经分配这里标志之*/
+	bitmap_fill(chunk->populated, pcpu_unit_pages);
+	chunk->nr_populated = pcpu_unit_pages;
+
+	pcpu_init_chunk_maps(chunk);
+
+	end_bit = clamp(end_bit, start_bit, map_bits);
+	if (start_bit)
+		pcpu_mark_area(chunk, 0, start_bit);
+	if (end_bit < map_bits)
+		pcpu_mark_area(chunk, end_bit, map_bits - end_bit);
+
+	return chunk;
+}
+
 /**
  * pcpu_setup_first_chunk - initialize the first percpu chunk
  * @ai: pcpu_alloc_info describing how to percpu area is shaped
@@ -1663,9 +1781,10 @@ static void pcpu_dump_alloc_info(const char *lvl,
  * If the first chunk ends up with both reserved and dynamic areas, it
  * is served by two chunks - one to serve the core static and reserved
  * areas and the other for the dynamic area.  They share the same vm
- * and page map but uses different area allocation map to stay away
- * from each other.  The latter chunk is circulated in the chunk slots
- * and available for dynamic allocation like any other chunks.
+ * and page map but uses different allocation bitmaps, each hiding the
+ * other's part of the unit, to stay away from each other.  The latter
+ * chunk is circulated in the chunk slots and available for dynamic
+ * allocation like any other chunks.
  *
  * RETURNS:
  * 0 on success, -errno on failure.
@@ -1674,8 +1793,6 @@ static void pcpu_dump_alloc_info(const char *lvl,
 int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 				  void *base_addr)
 {
-	static int smap[PERCPU_DYNAMIC_EARLY_SLOTS] __initdata;
-	static int dmap[PERCPU_DYNAMIC_EARLY_SLOTS] __initdata;
 	size_t dyn_size = ai->dyn_size;
 	size_t size_sum = ai->static_size + ai->reserved_size + dyn_size;
 	struct pcpu_chunk *schunk, *dchunk = NULL;
@@ -1685,6 +1802,7 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 	unsigned int cpu;
 	int *unit_map;
 	int group, unit, i;
+	struct pcpu_block_md *block;
 
 #define PCPU_SETUP_BUG_ON(cond)	do {					\
 	if (unlikely(cond)) {						\
@@ -1814,77 +1932,27 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 	 * static percpu allocation).
 	 */
 	/*构建静态chunck,即pcpu_reserved_chunk*/
-	schunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
-	INIT_LIST_HEAD(&schunk->list);
-	INIT_LIST_HEAD(&schunk->map_extend_list);
-	/*整个系统中percpu内存的起始地址*/
-	schunk->base_addr = base_addr;
-	/*初始化为一个静态数组*/
-	schunk->map = smap;
-	/*PERCPU_DYNAMIC_EARLY_SLOTS=128*/
-	schunk->map_alloc = ARRAY_SIZE(smap);
-	schunk->immutable = true;
-	/*
-	 *物理内存已经分配这里标志之. 若pcpu_unit_pages=8即每个
-	 *cpu占用的percpu空间为8页的空间，则populated域被设置为0xff
-	 */
-	bitmap_fill(schunk->populated, pcpu_unit_pages);
-	schunk->nr_populated = pcpu_unit_pages;
-
 	if (ai->reserved_size) {
 		/*如果存在percpu保留空间，在指定reserved分配时作为空闲空间使用*/
-		schunk->free_size = ai->reserved_size;
+		schunk = pcpu_alloc_first_chunk(base_addr, ai->static_size,
+						ai->reserved_size);
 		pcpu_reserved_chunk = schunk;
 		/*静态chunk的大小限制包括，定义的静态变量的空间+保留的空间*/
 		pcpu_reserved_chunk_limit = ai->static_size + ai->reserved_size;
 	} else {
 		/*若不存在保留空间，则将动态分配空间作为空闲空间使用*/
-		schunk->free_size = dyn_size;
+		schunk = pcpu_alloc_first_chunk(base_addr, ai->static_size,
+						dyn_size);
 		/*覆盖掉动态分配空间*/
 		dyn_size = 0;			/* dynamic area covered */
 	}
-	/*记录静态chunk中空闲可使用的percpu空间大小*/
-	schunk->contig_hint = schunk->free_size;
-
-	schunk->map[0] = 1;
-	/*
-	 *map数组保存空间的使用情况，负数为已使用的空间，
-	 *正数表示为以后可以分配的空间. map_used记录chunk中存在几个map项
-	 */
-	schunk->map[1] = ai->static_size;
-	schunk->map_used = 1;
-	if (schunk->free_size)
-		schunk->map[++schunk->map_used] = ai->static_size + schunk->free_size;
-	schunk->map[schunk->map_used] |= 1;
 
 	/* init dynamic chunk if necessary */
 	/*构建动态chunk分配空间*/
-	if (dyn_size) {
-		dchunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
-		INIT_LIST_HEAD(&dchunk->list);
-		INIT_LIST_HEAD(&dchunk->map_extend_list);
-		/*整个系统中percpu内存的起始地址*/
-		dchunk->base_addr = base_addr;
-		/*初始化为一个静态数组*/
-		dchunk->map = dmap;
-		/*PERCPU_DYNAMIC_EARLY_SLOTS=128*/
-		dchunk->map_alloc = ARRAY_SIZE(dmap);
-		dchunk->immutable = true;
-		/*记录下来分配的物理页*/
-		bitmap_fill(dchunk->populated, pcpu_unit_pages);
-		dchunk->nr_populated = pcpu_unit_pages;
-
-		/*设置动态chunk中的空闲可分配空间大小*/
-		dchunk->contig_hint = dchunk->free_size = dyn_size;
-		/*
-		 * map数组保存空间的使用情况，负数为已使用的空间
-		 *（静态变量空间和reserved空间），正数表示为以后可以分配的空间
-		 */
-		dchunk->map[0] = 1;
-		dchunk->map[1] = pcpu_reserved_chunk_limit;
-		dchunk->map[2] = (pcpu_reserved_chunk_limit + dchunk->free_size) | 1;
-		dchunk->map_used = 2;
-	}
+	if (dyn_size)
+		dchunk = pcpu_alloc_first_chunk(base_addr,
+						pcpu_reserved_chunk_limit,
+						dyn_size);
 
 	/* link the first chunk in */
 	/*
@@ -1892,8 +1960,10 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 	 *有自己单独的chunk：pcpu_reserved_chunk
 	 */
 	pcpu_first_chunk = dchunk ?: schunk;
-	pcpu_nr_empty_pop_pages +=
-		pcpu_count_occupied_pages(pcpu_first_chunk, 1);
+	for (i = 0, block = pcpu_first_chunk->md_blocks;
+	     i < pcpu_unit_pages; i++, block++)
+		if (pcpu_block_empty(block))
+			pcpu_nr_empty_pop_pages++;
 	pcpu_chunk_relocate(pcpu_first_chunk, -1);
 
 	/* we're done */
@@ -2552,36 +2622,6 @@ void __init setup_per_cpu_areas(void)
 
 #endif	/* CONFIG_SMP */
 
-/*
- * First and reserved chunks are initialized with temporary allocation
- * map in initdata so that they can be used before slab is online.
- * This function is called after slab is brought up and replaces those
- * with properly allocated maps.
- */
-void __init percpu_init_late(void)
-{
-	struct pcpu_chunk *target_chunks[] =
-		{ pcpu_first_chunk, pcpu_reserved_chunk, NULL };
-	struct pcpu_chunk *chunk;
-	unsigned long flags;
-	int i;
-
-	for (i = 0; (chunk = target_chunks[i]); i++) {
-		int *map;
-		const size_t size = PERCPU_DYNAMIC_EARLY_SLOTS * sizeof(map[0]);
-
-		BUILD_BUG_ON(size > PAGE_SIZE);
-
-		map = pcpu_mem_zalloc(size);
-		BUG_ON(!map);
-
-		spin_lock_irqsave(&pcpu_lock, flags);
-		memcpy(map, chunk->map, size);
-		chunk->map = map;
-		spin_unlock_irqrestore(&pcpu_lock, flags);
-	}
-}
-
 /*
  * Percpu allocator is initialized early during boot when neither slab or
  * workqueue is available.  Plug async management until everything is up
@@ -611,14 +611,43 @@ void try_to_unmap_flush_dirty(void)
 		try_to_unmap_flush();
 }
 
+#define TLB_FLUSH_BATCH_FLUSHED_SHIFT	16
+#define TLB_FLUSH_BATCH_PENDING_MASK			\
+	((1 << (TLB_FLUSH_BATCH_FLUSHED_SHIFT - 1)) - 1)
+#define TLB_FLUSH_BATCH_PENDING_LARGE			\
+	(TLB_FLUSH_BATCH_PENDING_MASK / 2)
+
 static void set_tlb_ubc_flush_pending(struct mm_struct *mm,
 		struct page *page, bool writable)
 {
 	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+	int batch, old;
 
 	cpumask_or(&tlb_ubc->cpumask, &tlb_ubc->cpumask, mm_cpumask(mm));
 	tlb_ubc->flush_required = true;
 
+	/*
+	 * The PTE must be seen cleared before the mm is marked, see
+	 * flush_tlb_batched_pending().
+	 */
+	barrier();
+	batch = atomic_read(&mm->tlb_flush_batched);
+	for (;;) {
+		if ((batch & TLB_FLUSH_BATCH_PENDING_MASK) <=
+		    TLB_FLUSH_BATCH_PENDING_LARGE) {
+			atomic_inc(&mm->tlb_flush_batched);
+			break;
+		}
+		/*
+		 * Restart both counts before pending can wrap round and
+		 * catch up with flushed: one pending, none flushed.
+		 */
+		old = atomic_cmpxchg(&mm->tlb_flush_batched, batch, 1);
+		if (old == batch)
+			break;
+		batch = old;
+	}
+
 	/*
 	 * If the PTE was dirty then it's best to assume it's writable. The
 	 * caller must use try_to_unmap_flush_dirty() or try_to_unmap_flush()
@@ -628,6 +657,32 @@ static void set_tlb_ubc_flush_pending(struct mm_struct *mm,
 		tlb_ubc->writable = true;
 }
 
+/*
+ * Reclaim clears PTEs under the PTL but, with batching, only flushes the
+ * TLB once the whole batch has been unmapped.  An munmap() or similar
+ * running in that window would find the PTE already gone and skip the
+ * flush, leaving a stale TLB entry pointing at a page about to be freed.
+ * Rather than tracking every mm with a flush in flight, reclaim marks the
+ * mm, and anyone tearing down PTEs calls this under the PTL and pays one
+ * flush_tlb_mm() if a batched flush may still be outstanding.
+ *
+ * Reclaim may mark the mm again, under another PTL, while the flush
+ * below is in progress.  So the mark is a count rather than a flag, and
+ * it is only cleared if nothing was added during the flush.
+ */
+void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+	int batch = atomic_read(&mm->tlb_flush_batched);
+	int pending = batch & TLB_FLUSH_BATCH_PENDING_MASK;
+	int flushed = batch >> TLB_FLUSH_BATCH_FLUSHED_SHIFT;
+
+	if (pending != flushed) {
+		flush_tlb_mm(mm);
+		atomic_cmpxchg(&mm->tlb_flush_batched, batch,
+			       pending | (pending << TLB_FLUSH_BATCH_FLUSHED_SHIFT));
+	}
+}
+
 /*
  * Returns true if the TLB flush should be deferred to the end of a batch of
  * unmap operations to reduce IPIs.
@@ -2300,6 +2300,9 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	c->freelist = NULL;
 }
 
+static void slab_magazine_drain(struct kmem_cache *s,
+				struct kmem_cache_magazine *m, unsigned int nr);
+
 /*
  * Flush cpu slab.
  *
@@ -2309,6 +2312,13 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->magazine) {
+		struct kmem_cache_magazine *m = per_cpu_ptr(s->magazine, cpu);
+
+		if (m->count)
+			slab_magazine_drain(s, m, m->count);
+	}
+
 	if (likely(c)) {
 		if (c->page)
 			flush_slab(s, c);
@@ -2329,6 +2339,9 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->magazine && per_cpu_ptr(s->magazine, cpu)->count)
+		return true;
+
 	return c->page || c->partial;
 }
 
@@ -2702,6 +2715,8 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	return p;
 }
 
+static void *slab_magazine_alloc(struct kmem_cache *s, int node);
+
 /*
  * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
  * have the fastpath folded into their functions. So no function call
@@ -2771,9 +2786,12 @@ redo:
 	或者当前slab使用内存页面与管理节点是否不匹配
 */
 	if (unlikely(!object || !node_match(page, node))) {
-		/* 慢速分配流程 */
-		object = __slab_alloc(s, gfpflags, node, addr, c);
-		stat(s, ALLOC_SLOWPATH);
+		object = slab_magazine_alloc(s, node);
+		if (!object) {
+			/* 慢速分配流程 */
+			object = __slab_alloc(s, gfpflags, node, addr, c);
+			stat(s, ALLOC_SLOWPATH);
+		}
 	} else {
 	    // 从本地缓存获取
 		void *next_object = get_freepointer_safe(s, object);
@@ -3059,6 +3077,9 @@ slab_empty:
 	discard_slab(s, page);
 }
 
+static bool slab_magazine_free(struct kmem_cache *s, struct page *page,
+			       void *object);
+
 /*
  * Fastpath with forced inlining to produce a kfree and kmem_cache_free that
  * can perform fastpath freeing without additional function calls.
@@ -3111,7 +3132,7 @@ redo:
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
-	} else
+	} else if (tail || !slab_magazine_free(s, page, head))
 		__slab_free(s, page, head, tail_obj, cnt, addr);
 
 }
@@ -3248,6 +3269,102 @@ int build_detached_freelist(struct kmem_cache *s, size_t size,
 	return first_skipped_index;
 }
 
+/*
+ * Per cpu magazines.
+ *
+ * A magazine is a small per cpu array of free objects in front of the
+ * cpu slab. Frees that miss the cpu slab (typically objects allocated on
+ * another cpu, e.g. skbs completed on the irq cpu) are parked in the
+ * magazine instead of going through __slab_free() one object at a time,
+ * and allocations that miss the lockless freelist are served from the
+ * magazine before ___slab_alloc() goes to the node partial list.
+ *
+ * A full magazine is drained by half in one go. build_detached_freelist()
+ * groups the parked objects by slab page so that each page is handed back
+ * with a single cmpxchg and, at most, one list_lock round trip. Once the
+ * magazine is empty, refill happens through the normal slow path which
+ * loads a whole slab freelist into the cpu slab under one list_lock hold.
+ *
+ * Magazines are off by default and enabled per cache with the "magazine"
+ * and "magazine_size" sysfs attributes. Debug caches never use them since
+ * the consistency checks are done in the slow paths.
+ */
+static DEFINE_MUTEX(slab_magazine_mutex);
+
+/* Called with interrupts disabled. */
+static void slab_magazine_drain(struct kmem_cache *s,
+				struct kmem_cache_magazine *m, unsigned int nr)
+{
+	size_t size = nr;
+
+	/* Hand back the oldest objects, they are the coldest ones */
+	while (size) {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, m->objects, &df);
+		if (!df.page)
+			continue;
+
+		__slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			    _RET_IP_);
+	}
+
+	m->count -= nr;
+	memmove(m->objects, m->objects + nr, m->count * sizeof(void *));
+	stat(s, MAGAZINE_DRAIN);
+}
+
+static void *slab_magazine_alloc(struct kmem_cache *s, int node)
+{
+	struct kmem_cache_magazine *m;
+	unsigned long flags;
+	void *object = NULL;
+
+	/* Parked objects may come from any node */
+	if (!smp_load_acquire(&s->magazine_enabled) || node != NUMA_NO_NODE)
+		return NULL;
+
+	local_irq_save(flags);
+	m = this_cpu_ptr(s->magazine);
+	if (m->count) {
+		object = m->objects[--m->count];
+		stat(s, MAGAZINE_ALLOC);
+	}
+	local_irq_restore(flags);
+
+	return object;
+}
+
+static bool slab_magazine_free(struct kmem_cache *s, struct page *page,
+			       void *object)
+{
+	struct kmem_cache_magazine *m;
+	unsigned long flags;
+
+	/* Do not let reserve objects leak to ordinary allocations */
+	if (!smp_load_acquire(&s->magazine_enabled) || PageSlabPfmemalloc(page))
+		return false;
+
+	local_irq_save(flags);
+	/*
+	 * magazine_store() clears magazine_enabled before flush_all() sends
+	 * its IPIs, so seen still set here, with interrupts off, this cpu's
+	 * flush has not run yet and will drain what is parked now.
+	 */
+	if (unlikely(!READ_ONCE(s->magazine_enabled))) {
+		local_irq_restore(flags);
+		return false;
+	}
+	m = this_cpu_ptr(s->magazine);
+	if (unlikely(m->count >= READ_ONCE(s->magazine_size)))
+		slab_magazine_drain(s, m, m->count - m->count / 2);
+	m->objects[m->count++] = object;
+	stat(s, MAGAZINE_FREE);
+	local_irq_restore(flags);
+
+	return true;
+}
+
 /* Note that interrupts must be enabled when calling this function. */
 void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 {
@@ -3594,6 +3711,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+	free_percpu(s->magazine);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -3877,6 +3995,8 @@ static int kmem_cache_open(struct kmem_cache *s, unsigned long flags)
 	else
 		s->cpu_partial = 30;
 
+	s->magazine_size = SLUB_MAGAZINE_DEFAULT;
+
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
 #endif
@@ -5313,6 +5433,68 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t magazine_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->magazine_enabled);
+}
+
+static ssize_t magazine_store(struct kmem_cache *s, const char *buf,
+			      size_t length)
+{
+	unsigned long enable;
+	int err;
+
+	err = kstrtoul(buf, 10, &enable);
+	if (err)
+		return err;
+
+	if (!enable) {
+		WRITE_ONCE(s->magazine_enabled, 0);
+		flush_all(s);
+		return length;
+	}
+
+	if (kmem_cache_debug(s))
+		return -EINVAL;
+
+	mutex_lock(&slab_magazine_mutex);
+	if (!s->magazine) {
+		s->magazine = alloc_percpu(struct kmem_cache_magazine);
+		if (!s->magazine) {
+			mutex_unlock(&slab_magazine_mutex);
+			return -ENOMEM;
+		}
+	}
+	/* Pairs with smp_load_acquire() in the magazine fast paths */
+	smp_store_release(&s->magazine_enabled, 1);
+	mutex_unlock(&slab_magazine_mutex);
+	return length;
+}
+SLAB_ATTR(magazine);
+
+static ssize_t magazine_size_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->magazine_size);
+}
+
+static ssize_t magazine_size_store(struct kmem_cache *s, const char *buf,
+				   size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = kstrtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects < 2 || objects > SLUB_MAGAZINE_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(s->magazine_size, objects);
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(magazine_size);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5714,6 +5896,9 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(MAGAZINE_ALLOC, magazine_alloc);
+STAT_ATTR(MAGAZINE_FREE, magazine_free);
+STAT_ATTR(MAGAZINE_DRAIN, magazine_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5723,6 +5908,8 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&magazine_attr.attr,
+	&magazine_size_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5781,6 +5968,9 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&magazine_alloc_attr.attr,
+	&magazine_free_attr.attr,
+	&magazine_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -35,6 +35,8 @@
 #include <linux/swapfile.h>
 #include <linux/export.h>
 #include <linux/swap_slots.h>
+#include <linux/sort.h>
+#include <linux/debugfs_stat.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -102,6 +104,22 @@ static DECLARE_WAIT_QUEUE_HEAD(proc_poll_wait);
 /* Activity counter to indicate that a swapon or swapoff has occurred */
 static atomic_t proc_poll_event = ATOMIC_INIT(0);
 
+/*
+ * Traffic between the per-CPU swap slot caches and the swap devices.  The
+ * caches refill through get_swap_pages() and return freed entries through
+ * swapcache_free_entries(), so these show how well the batching works.
+ */
+struct swap_slots_stat {
+	unsigned long refills;		/* get_swap_pages() calls */
+	unsigned long refill_wanted;	/* entries asked for */
+	unsigned long refill_got;	/* entries handed out */
+	unsigned long returns;		/* swapcache_free_entries() calls */
+	unsigned long returned;		/* entries given back */
+	unsigned long return_locks;	/* si->lock taken while giving back */
+};
+
+static DEFINE_PER_CPU(struct swap_slots_stat, swap_slots_stat);
+
 static inline unsigned char swap_count(unsigned char ent)
 {
 	return ent & ~SWAP_HAS_CACHE;	/* may include SWAP_HAS_CONT flag */
@@ -876,6 +894,9 @@ nextsi:
 check_out:
 	if (n_ret < n_goal)
 		atomic_long_add((long) (n_goal-n_ret), &nr_swap_pages);
+	this_cpu_inc(swap_slots_stat.refills);
+	this_cpu_add(swap_slots_stat.refill_wanted, n_goal);
+	this_cpu_add(swap_slots_stat.refill_got, n_ret);
 noswap:
 	return n_ret;
 }
@@ -1104,14 +1125,32 @@ void swapcache_free(swp_entry_t entry)
 	}
 }
 
+static int swp_entry_cmp(const void *ent1, const void *ent2)
+{
+	const swp_entry_t *e1 = ent1, *e2 = ent2;
+
+	if (e1->val == e2->val)
+		return 0;
+	return e1->val < e2->val ? -1 : 1;
+}
+
 void swapcache_free_entries(swp_entry_t *entries, int n)
 {
 	struct swap_info_struct *p, *prev;
+	unsigned long locks = 0;
 	int i;
 
 	if (n <= 0)
 		return;
 
+	/*
+	 * Entries cached on a CPU can come from several swap devices.  Sort
+	 * them so that each si->lock is taken once per batch instead of
+	 * bouncing between devices, and so offsets are freed in order.
+	 */
+	if (nr_swapfiles > 1)
+		sort(entries, n, sizeof(entries[0]), swp_entry_cmp, NULL);
+
 	prev = NULL;
 	p = NULL;
 	for (i = 0; i < n; ++i) {
@@ -1120,10 +1159,16 @@ void swapcache_free_entries(swp_entry_t *entries, int n)
 			swap_entry_free(p, entries[i]);
 		else
 			break;
+		if (p != prev)
+			locks++;
 		prev = p;
 	}
 	if (p)
 		spin_unlock(&p->lock);
+
+	this_cpu_inc(swap_slots_stat.returns);
+	this_cpu_add(swap_slots_stat.returned, i);
+	this_cpu_add(swap_slots_stat.return_locks, locks);
 }
 
 /*
@@ -2532,6 +2577,36 @@ static int __init procswaps_init(void)
 __initcall(procswaps_init);
 #endif /* CONFIG_PROC_FS */
 
+#ifdef CONFIG_DEBUG_FS
+static int swap_slots_stat_show(struct seq_file *m, void *v)
+{
+	struct swap_slots_stat sum;
+
+	percpu_stat_sum(&swap_slots_stat, &sum);
+	seq_printf(m, "refills %lu wanted %lu got %lu\n",
+		   sum.refills, sum.refill_wanted, sum.refill_got);
+	seq_printf(m, "returns %lu entries %lu lock_rounds %lu\n",
+		   sum.returns, sum.returned, sum.return_locks);
+	return 0;
+}
+
+static void swap_slots_stat_reset(void *data)
+{
+	percpu_stat_reset(&swap_slots_stat);
+}
+
+DEFINE_DEBUGFS_STAT(swap_slots_stat);
+
+static int __init swap_slots_stat_debugfs(void)
+{
+	if (!debugfs_create_file("swap_slots", 0600, NULL, NULL,
+				 &swap_slots_stat_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(swap_slots_stat_debugfs);
+#endif /* CONFIG_DEBUG_FS */
+
 #ifdef MAX_SWAPFILES_CHECK
 static int __init max_swapfiles_check(void)
 {
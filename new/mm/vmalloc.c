@@ -23,6 +23,7 @@
 #include <linux/list.h>
 #include <linux/notifier.h>
 #include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -292,6 +293,7 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 /*** Global kva allocator ***/
 
 #define VM_VM_AREA	0x04
+#define VM_VB_AREA	0x08	/* vmap block that also backs vmalloc() areas */
 
 static DEFINE_SPINLOCK(vmap_area_lock);
 /* Export for kexec only */
@@ -299,14 +301,36 @@ LIST_HEAD(vmap_area_list);
 static LLIST_HEAD(vmap_purge_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * Every vmap_area remembers the size of the free hole between the end of
+ * the previous area and its own start (the lowest area measures from 0),
+ * and the rbtree is augmented with the largest such hole in each subtree.
+ * That lets alloc_vmap_area() skip whole subtrees that cannot satisfy a
+ * request instead of walking the address sorted list.
+ */
+static inline unsigned long vmap_subtree_max_hole(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct vmap_area, rb_node)->subtree_max_hole : 0;
+}
+
+static inline unsigned long compute_subtree_max_hole(struct vmap_area *va)
+{
+	return max3(va->hole, vmap_subtree_max_hole(va->rb_node.rb_left),
+		    vmap_subtree_max_hole(va->rb_node.rb_right));
+}
+
+RB_DECLARE_CALLBACKS(static, vmap_hole_cb, struct vmap_area, rb_node,
+		     unsigned long, subtree_max_hole, compute_subtree_max_hole)
+
+/* Recompute the hole below @va after its lower neighbour has changed */
+static void vmap_update_hole(struct vmap_area *va, unsigned long prev_end)
+{
+	va->hole = va->va_start - prev_end;
+	vmap_hole_cb_propagate(&va->rb_node, NULL);
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -346,10 +370,24 @@ static void __insert_vmap_area(struct vmap_area *va)
 	}
 
 	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
 
-	/* address-sort this list */
+	/*
+	 * The augmented values on the path down to the new leaf must be
+	 * valid before rebalancing, and so must the hole of the area that
+	 * now sits right above us.
+	 */
 	tmp = rb_prev(&va->rb_node);
+	va->hole = va->va_start - (tmp ?
+			rb_entry(tmp, struct vmap_area, rb_node)->va_end : 0);
+	va->subtree_max_hole = va->hole;
+	if (parent)
+		vmap_hole_cb_propagate(parent, NULL);
+	if (rb_next(&va->rb_node))
+		vmap_update_hole(rb_entry(rb_next(&va->rb_node),
+					  struct vmap_area, rb_node), va->va_end);
+	rb_insert_augmented(&va->rb_node, &vmap_area_root, &vmap_hole_cb);
+
+	/* address-sort this list */
 	if (tmp) {
 		struct vmap_area *prev;
 		prev = rb_entry(tmp, struct vmap_area, rb_node);
@@ -358,6 +396,79 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &vmap_area_list);
 }
 
+/*
+ * Check whether a @size sized, @align aligned range fits into the hole
+ * below @va without leaving [@vstart, @vend).
+ */
+static bool vmap_hole_fits(struct vmap_area *va, unsigned long size,
+			   unsigned long align, unsigned long vstart,
+			   unsigned long vend, unsigned long *addrp)
+{
+	unsigned long addr;
+
+	addr = ALIGN(max(va->va_start - va->hole, vstart), align);
+	if (addr < vstart || addr + size < addr)
+		return false;
+	if (addr + size > va->va_start || addr + size > vend)
+		return false;
+
+	*addrp = addr;
+	return true;
+}
+
+/*
+ * Find the lowest hole able to hold @size bytes aligned to @align within
+ * [@vstart, @vend).  Subtrees whose largest hole is smaller than the worst
+ * case requirement are pruned, so this is O(log n) in the common case.
+ * Every hole starts on a page boundary, so up to page alignment the worst
+ * case is @size itself and an exactly fitting hole is not passed over.
+ * Returns the area right above the hole, or NULL if no hole between areas
+ * fits and the caller has to try above the last area.
+ */
+static struct vmap_area *find_vmap_lowest_hole(unsigned long size,
+		unsigned long align, unsigned long vstart, unsigned long vend,
+		unsigned long *addrp)
+{
+	unsigned long length = align > PAGE_SIZE ? size + align - 1 : size;
+	struct rb_node *node = vmap_area_root.rb_node;
+	struct vmap_area *va;
+
+	if (length < size)
+		return NULL;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		/* Holes left of an area starting at or below vstart are useless */
+		if (vstart < va->va_start &&
+		    vmap_subtree_max_hole(node->rb_left) >= length) {
+			node = node->rb_left;
+			continue;
+		}
+
+		for (;;) {
+			if (vmap_hole_fits(va, size, align, vstart, vend, addrp))
+				return va;
+			/* Everything further right starts beyond vend */
+			if (va->va_start - va->hole >= vend)
+				return NULL;
+			if (vmap_subtree_max_hole(node->rb_right) >= length) {
+				node = node->rb_right;
+				break;
+			}
+			/* Climb to the first ancestor we are a left child of */
+			while (rb_parent(node) && node == rb_parent(node)->rb_right)
+				node = rb_parent(node);
+			node = rb_parent(node);
+			if (!node)
+				return NULL;
+			va = rb_entry(node, struct vmap_area, rb_node);
+		}
+	}
+
+	return NULL;
+}
+
 static void purge_vmap_area_lazy(void);
 
 static BLOCKING_NOTIFIER_HEAD(vmap_notify_list);
@@ -376,7 +487,6 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
     /**
          * 这几种情况都是不可饶恕的错误:
          *        长度为0
@@ -406,96 +516,19 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 retry:
     /* 获得保护KVA红黑树的自旋锁 */
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	/* 从上次分配的区域开始向后查找 */
-	if (free_vmap_cache) {
-	/* 得到上次分配的KVA描述符 */
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-    /* 上次分配的结束地址向上对齐，得到本次可用的地址 */
-		addr = ALIGN(first->va_end, align);
-		/* 可用地址小于我们的起始地址，缓存失效 */
-		if (addr < vstart)
-			goto nocache;
-	 /**
-         * 溢出，说明地址空间不足。 
-         * 初看似乎这里有点问题，因为从上次分配的结点开始向后查找可用空间，即使后面的可用空间不足，也不能表示真的没有可用空间了。
-         * 因为前面已经分配的空间之间应该还有空洞。
-         * 实际上内核这样处理是没有问题。请阅读时注意。
-         */
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-	/* 将虚拟地址向上对齐，对vmalloc来说，vstart表示可以使用的虚拟地址空间起始地址 */
-		addr = ALIGN(vstart, align);
-		/* 长度太长，造成整形溢出，退出。这类检查可以防止安全方面的问题 */
-		if (addr + size < addr)
-			goto overflow;
-        /* 获取KVA(应该是指kernel vitural address)红黑树的根，从根开始遍历树 */
-		n = vmap_area_root.rb_node;
-		first = NULL;
-        /* 遍历红黑树 */
-		while (n) {
-			struct vmap_area *tmp;
-			/* 获取当前红黑树节点对应的vmap_area描述符 */
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-			/* 该区域结束地址大于我们要搜索的起始地址 */
-				first = tmp;
-				if (tmp->va_start <= addr)
-				/* 该区域起始地址小于我们要搜索的起始地址 */
-                /* 这种情况下，说明我们可以从当前节点开始查找地址空间了 */
-					break;
-				/* 否则，说明该节点还位于较高端，我们移动到树的左节点上，查找更小的区域 */
-				n = n->rb_left;
-			} else
-			/* 否则说明该节点代表的区域还比较小，我们需要移动到右节点上，查找更大的区域 */
-				n = n->rb_right;
-		}
-        /* 我们要查找的区域大于当前树中所有的区域，说明我们的地址区间还没有被占用 */
-		if (!first)
-			goto found;
-	}
+	/* 在增强红黑树中查找满足要求的最低地址空洞 */
+	if (find_vmap_lowest_hole(size, align, vstart, vend, &addr))
+		goto found;
 
-	/* from the starting point, walk areas until a suitable hole is found */
-    /* 运行到这里，说明我们要查找的区间位于红黑树的区域范围内，从当前节点开始，搜索合适大小的区间空洞 */
-	while (addr + size > first->va_start && addr + size <= vend) {
-	/* 要求的地址空间与当前节点重叠，说明需要向后移动节点，查找更高范围的地址空间 */
-		if (addr + cached_hole_size < first->va_start)
-		/* 根据当前地址到当前区间的起始地址之间有距离，计算空洞大小 */
-			cached_hole_size = first->va_start - addr;
-        /* 可用地址是当前区间结束地址向上对齐的地址 */
-		addr = ALIGN(first->va_end, align);
-		/* 整形溢出了，退出。说明空间不足。 */
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_next_entry(first, list);
-	}
+	/* 没有合适的空洞，只能从最后一个区域之后分配 */
+	n = rb_last(&vmap_area_root);
+	addr = vstart;
+	if (n)
+		addr = max(addr, rb_entry(n, struct vmap_area, rb_node)->va_end);
+	addr = ALIGN(addr, align);
+	/* 长度太长，造成整形溢出，退出。这类检查可以防止安全方面的问题 */
+	if (addr < vstart || addr + size < addr)
+		goto overflow;
 
 found:
     /* 可用地址加上分配长度超过了分配范围，说明地址空间不足了，退出 */
@@ -507,8 +540,6 @@ found:
 	va->flags = 0;
 	/* 将分配的vmap_area插入到红黑树中，代表这一段地址空间已经从KVA中分配出去了 */
 	__insert_vmap_area(va);
-	/* 记录下本次分配的空间，下次分配可从该节点开始搜索，提高搜索速度用 */
-	free_vmap_cache = &va->rb_node;
 	/* 释放KVA红黑树的自旋锁 */
 	spin_unlock(&vmap_area_lock);
 
@@ -540,7 +571,7 @@ overflow:
 		}
 	}
     /* 运行到这里，说明实在没有可用空间了，打印一下警告信息。注意这里用了printk_ratelimit，防止Dos攻击 */
-	if (printk_ratelimit())
+	if (!(gfp_mask & __GFP_NOWARN) && printk_ratelimit())
 		pr_warn("vmap allocation for size %lu failed: use vmalloc=<size> to increase size\n",
 			size);
     /* 没有分配到可用空间，释放临时分配的KVA描述符 */
@@ -562,25 +593,17 @@ EXPORT_SYMBOL_GPL(unregister_vmap_purge_notifier);
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct rb_node *next;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
+	next = rb_next(&va->rb_node);
+	rb_erase_augmented(&va->rb_node, &vmap_area_root, &vmap_hole_cb);
 	RB_CLEAR_NODE(&va->rb_node);
+	/* The hole below the next area now swallows this one */
+	if (next)
+		vmap_update_hole(rb_entry(next, struct vmap_area, rb_node),
+				 va->va_start - va->hole);
 	list_del_rcu(&va->list);
 
 	/*
@@ -810,6 +833,24 @@ static struct vmap_area *find_vmap_area(unsigned long addr)
 
 #define VMAP_BLOCK_SIZE		(VMAP_BBMAP_BITS * PAGE_SIZE)
 
+/*
+ * vmalloc() requests up to this many pages (guard page included) are served
+ * from the per-CPU vmap blocks.  Block space is handed out in power of two
+ * chunks, so keep this well below VMAP_MAX_ALLOC to bound the waste.
+ */
+#define VMAP_VMALLOC_MAX	(VMAP_MAX_ALLOC / 4)
+
+/*
+ * Block space is only reused once the whole block has been freed, so a
+ * single long-lived small vmalloc() pins a whole block.  Blocks backing
+ * vmalloc() are therefore limited to 1/16th of the vmalloc range; past
+ * that, vmalloc() falls back to the vmap_area tree.
+ */
+#define VMAP_VMALLOC_BLOCKS_MAX	\
+	((VMALLOC_END - VMALLOC_START) / VMAP_BLOCK_SIZE / 16)
+
+static atomic_t nr_vmalloc_blocks = ATOMIC_INIT(0);
+
 static bool vmap_initialized __read_mostly = false;
 
 struct vmap_block_queue {
@@ -825,6 +866,8 @@ struct vmap_block {
 	struct list_head free_list;
 	struct rcu_head rcu_head;
 	struct list_head purge;
+	/* vmalloc areas indexed by first page, NULL for vm_map_ram only blocks */
+	struct vm_struct **vms;
 };
 
 /* Queue of free and dirty vmap blocks, for allocation and flushing purposes */
@@ -866,38 +909,54 @@ static void *vmap_block_vaddr(unsigned long va_start, unsigned long pages_off)
  *                  block. Of course pages number can't exceed VMAP_BBMAP_BITS
  * @order:    how many 2^order pages should be occupied in newly allocated block
  * @gfp_mask: flags for the page level allocator
+ * @vm:       vmalloc area to be placed at the start of the block, or NULL
  *
  * Returns: virtual address in a newly allocated block or ERR_PTR(-errno)
  */
-static void *new_vmap_block(unsigned int order, gfp_t gfp_mask)
+static void *new_vmap_block(unsigned int order, gfp_t gfp_mask,
+			    struct vm_struct *vm)
 {
 	struct vmap_block_queue *vbq;
 	struct vmap_block *vb;
 	struct vmap_area *va;
 	unsigned long vb_idx;
+	size_t vb_size;
 	int node, err;
 	void *vaddr;
 
 	node = numa_node_id();
 
-	vb = kmalloc_node(sizeof(struct vmap_block),
-			gfp_mask & GFP_RECLAIM_MASK, node);
-	if (unlikely(!vb))
-		return ERR_PTR(-ENOMEM);
+	/* Blocks backing vmalloc() carry their area table right behind them */
+	vb_size = sizeof(struct vmap_block);
+	if (vm) {
+		if (atomic_inc_return(&nr_vmalloc_blocks) >
+		    VMAP_VMALLOC_BLOCKS_MAX) {
+			atomic_dec(&nr_vmalloc_blocks);
+			return ERR_PTR(-EBUSY);
+		}
+		vb_size += VMAP_BBMAP_BITS * sizeof(struct vm_struct *);
+	}
+
+	vb = kzalloc_node(vb_size, gfp_mask & GFP_RECLAIM_MASK, node);
+	if (unlikely(!vb)) {
+		err = -ENOMEM;
+		goto out_dec;
+	}
 
 	va = alloc_vmap_area(VMAP_BLOCK_SIZE, VMAP_BLOCK_SIZE,
 					VMALLOC_START, VMALLOC_END,
 					node, gfp_mask);
 	if (IS_ERR(va)) {
 		kfree(vb);
-		return ERR_CAST(va);
+		err = PTR_ERR(va);
+		goto out_dec;
 	}
 
 	err = radix_tree_preload(gfp_mask);
 	if (unlikely(err)) {
 		kfree(vb);
 		free_vmap_area(va);
-		return ERR_PTR(err);
+		goto out_dec;
 	}
 
 	vaddr = vmap_block_vaddr(va->va_start, 0);
@@ -910,6 +969,15 @@ static void *new_vmap_block(unsigned int order, gfp_t gfp_mask)
 	vb->dirty_min = VMAP_BBMAP_BITS;
 	vb->dirty_max = 0;
 	INIT_LIST_HEAD(&vb->free_list);
+	if (vm) {
+		vb->vms = (struct vm_struct **)(vb + 1);
+		vb->vms[0] = vm;
+		vm->addr = vaddr;
+
+		spin_lock(&vmap_area_lock);
+		va->flags |= VM_VB_AREA;
+		spin_unlock(&vmap_area_lock);
+	}
 
 	vb_idx = addr_to_vb_idx(va->va_start);
 	spin_lock(&vmap_block_tree_lock);
@@ -925,6 +993,11 @@ static void *new_vmap_block(unsigned int order, gfp_t gfp_mask)
 	put_cpu_var(vmap_block_queue);
 
 	return vaddr;
+
+out_dec:
+	if (vm)
+		atomic_dec(&nr_vmalloc_blocks);
+	return ERR_PTR(err);
 }
 
 static void free_vmap_block(struct vmap_block *vb)
@@ -938,6 +1011,8 @@ static void free_vmap_block(struct vmap_block *vb)
 	spin_unlock(&vmap_block_tree_lock);
 	BUG_ON(tmp != vb);
 
+	if (vb->vms)
+		atomic_dec(&nr_vmalloc_blocks);
 	free_vmap_area_noflush(vb->va);
 	kfree_rcu(vb, rcu_head);
 }
@@ -985,7 +1060,8 @@ static void purge_fragmented_blocks_allcpus(void)
 		purge_fragmented_blocks(cpu);
 }
 
-static void *vb_alloc(unsigned long size, gfp_t gfp_mask)
+static void *__vb_alloc(unsigned long size, gfp_t gfp_mask,
+			struct vm_struct *vm)
 {
 	struct vmap_block_queue *vbq;
 	struct vmap_block *vb;
@@ -1009,6 +1085,10 @@ static void *vb_alloc(unsigned long size, gfp_t gfp_mask)
 	list_for_each_entry_rcu(vb, &vbq->free, free_list) {
 		unsigned long pages_off;
 
+		/* vmalloc areas need a block that can record them */
+		if (vm && !vb->vms)
+			continue;
+
 		spin_lock(&vb->lock);
 		if (vb->free < (1UL << order)) {
 			spin_unlock(&vb->lock);
@@ -1018,6 +1098,10 @@ static void *vb_alloc(unsigned long size, gfp_t gfp_mask)
 		pages_off = VMAP_BBMAP_BITS - vb->free;
 		vaddr = vmap_block_vaddr(vb->va->va_start, pages_off);
 		vb->free -= 1UL << order;
+		if (vm) {
+			vm->addr = vaddr;
+			vb->vms[pages_off] = vm;
+		}
 		if (vb->free == 0) {
 			spin_lock(&vbq->lock);
 			list_del_rcu(&vb->free_list);
@@ -1033,11 +1117,16 @@ static void *vb_alloc(unsigned long size, gfp_t gfp_mask)
 
 	/* Allocate new block if nothing was found */
 	if (!vaddr)
-		vaddr = new_vmap_block(order, gfp_mask);
+		vaddr = new_vmap_block(order, gfp_mask, vm);
 
 	return vaddr;
 }
 
+static void *vb_alloc(unsigned long size, gfp_t gfp_mask)
+{
+	return __vb_alloc(size, gfp_mask, NULL);
+}
+
 static void vb_free(const void *addr, unsigned long size)
 {
 	unsigned long offset;
@@ -1078,6 +1167,87 @@ static void vb_free(const void *addr, unsigned long size)
 		spin_unlock(&vb->lock);
 }
 
+/*
+ * Find the vmalloc area that a vmap block hands out around @addr.  With
+ * @unlink set the area is also detached from the block; the caller then
+ * returns its space with vb_free().
+ */
+static struct vm_struct *vb_find_vm_area(unsigned long addr, bool unlink)
+{
+	struct vm_struct *vm = NULL;
+	struct vmap_block *vb;
+	unsigned long offset;
+	unsigned long i;
+
+	offset = (addr & (VMAP_BLOCK_SIZE - 1)) >> PAGE_SHIFT;
+
+	rcu_read_lock();
+	vb = radix_tree_lookup(&vmap_block_tree, addr_to_vb_idx(addr));
+	if (vb && vb->vms) {
+		spin_lock(&vb->lock);
+		/* No area spans more than VMAP_MAX_ALLOC pages */
+		for (i = offset; i + VMAP_MAX_ALLOC > offset; i--) {
+			vm = vb->vms[i];
+			if (vm || !i)
+				break;
+		}
+		if (vm && addr >= (unsigned long)vm->addr + vm->size)
+			vm = NULL;
+		if (vm && unlink)
+			vb->vms[i] = NULL;
+		spin_unlock(&vb->lock);
+	}
+	rcu_read_unlock();
+
+	return vm;
+}
+
+/*
+ * Small vmalloc() requests in the default range are carved out of the
+ * per-CPU vmap blocks, just like vm_map_ram().  The allocation only takes
+ * vmap_area_lock when it needs a new block, and the TLB flush is deferred
+ * until the whole block has been released and purged.
+ */
+static bool vb_vmalloc_fits(unsigned long size, unsigned long align,
+			    unsigned long start, unsigned long end,
+			    unsigned long vm_flags)
+{
+	if (!(vm_flags & VM_NO_GUARD))
+		size += PAGE_SIZE;
+
+	return vmap_initialized && align <= PAGE_SIZE &&
+		start == VMALLOC_START && end == VMALLOC_END &&
+		size <= VMAP_VMALLOC_MAX * PAGE_SIZE;
+}
+
+static struct vm_struct *vb_get_vm_area(unsigned long size,
+		unsigned long flags, int node, gfp_t gfp_mask,
+		const void *caller)
+{
+	struct vm_struct *area;
+	void *addr;
+
+	area = kzalloc_node(sizeof(*area), gfp_mask & GFP_RECLAIM_MASK, node);
+	if (unlikely(!area))
+		return NULL;
+
+	if (!(flags & VM_NO_GUARD))
+		size += PAGE_SIZE;
+
+	area->flags = flags;
+	area->size = size;
+	area->caller = caller;
+
+	/* Failure falls back to __get_vm_area_node(), so keep it quiet */
+	addr = __vb_alloc(size, gfp_mask | __GFP_NOWARN, area);
+	if (IS_ERR_OR_NULL(addr)) {
+		kfree(area);
+		return NULL;
+	}
+
+	return area;
+}
+
 /**
  * vm_unmap_aliases - unmap outstanding lazy aliases in the vmap layer
  *
@@ -1512,6 +1682,8 @@ struct vm_struct *find_vm_area(const void *addr)
 	va = find_vmap_area((unsigned long)addr);
 	if (va && va->flags & VM_VM_AREA)
 		return va->vm;
+	if (va && va->flags & VM_VB_AREA)
+		return vb_find_vm_area((unsigned long)addr, false);
 
 	return NULL;
 }
@@ -1550,6 +1722,24 @@ struct vm_struct *remove_vm_area(const void *addr)
 
 		return vm;
 	}
+	if (va && va->flags & VM_VB_AREA) {
+		struct vm_struct *vm;
+		unsigned long start;
+
+		/* vread() and vwrite() rely on vmap_area_lock, too */
+		spin_lock(&vmap_area_lock);
+		vm = vb_find_vm_area((unsigned long)addr, true);
+		spin_unlock(&vmap_area_lock);
+		if (!vm)
+			return NULL;
+
+		start = (unsigned long)vm->addr;
+		vmap_debug_free_range(start, start + vm->size);
+		kasan_free_shadow(vm);
+		vb_free(vm->addr, vm->size);
+
+		return vm;
+	}
 	return NULL;
 }
 
@@ -1929,8 +2119,14 @@ vmalloc分配的大小必须是页面的整数倍，这里将长度对齐到页
     在vmalloc地址区间中找到合适的区域，
     这是通过遍历vmlist链表来实现的  
 */
-	area = __get_vm_area_node(size, align, VM_ALLOC | VM_UNINITIALIZED |
-				vm_flags, start, end, node, gfp_mask, caller);
+	area = NULL;
+	if (vb_vmalloc_fits(size, align, start, end, vm_flags))
+		area = vb_get_vm_area(size, VM_ALLOC | VM_UNINITIALIZED |
+				vm_flags, node, gfp_mask, caller);
+	if (!area)
+		area = __get_vm_area_node(size, align, VM_ALLOC |
+				VM_UNINITIALIZED | vm_flags, start, end, node,
+				gfp_mask, caller);
 /*
 	vmalloc虚拟地址空间不足，可能是分配的长度太大，返回失败
 */
@@ -2238,6 +2434,36 @@ static int aligned_vread(char *buf, char *addr, unsigned long count)
 	return copied;
 }
 
+/*
+ * Iterate over the vmalloc areas of @va for vread() and vwrite(): the one
+ * area of a VM_VM_AREA, or the ones carved out of a vmap block, in address
+ * order.  @idx is the cursor and starts at 0.  Called with vmap_area_lock
+ * held, which keeps the returned area from being freed under us.
+ */
+static struct vm_struct *vmap_area_next_vm(struct vmap_area *va,
+					   unsigned long *idx)
+{
+	struct vm_struct *vm = NULL;
+	struct vmap_block *vb;
+
+	if (va->flags & VM_VM_AREA)
+		return (*idx)++ ? NULL : va->vm;
+	if (!(va->flags & VM_VB_AREA))
+		return NULL;
+
+	rcu_read_lock();
+	vb = radix_tree_lookup(&vmap_block_tree, addr_to_vb_idx(va->va_start));
+	if (vb && vb->vms) {
+		spin_lock(&vb->lock);
+		while (!vm && *idx < VMAP_BBMAP_BITS)
+			vm = vb->vms[(*idx)++];
+		spin_unlock(&vb->lock);
+	}
+	rcu_read_unlock();
+
+	return vm;
+}
+
 static int aligned_vwrite(char *buf, char *addr, unsigned long count)
 {
 	struct page *p;
@@ -2315,34 +2541,34 @@ long vread(char *buf, char *addr, unsigned long count)
 
 	spin_lock(&vmap_area_lock);
 	list_for_each_entry(va, &vmap_area_list, list) {
+		unsigned long idx = 0;
+
 		if (!count)
 			break;
 
-		if (!(va->flags & VM_VM_AREA))
-			continue;
-
-		vm = va->vm;
-		vaddr = (char *) vm->addr;
-		if (addr >= vaddr + get_vm_area_size(vm))
-			continue;
-		while (addr < vaddr) {
-			if (count == 0)
-				goto finished;
-			*buf = '\0';
-			buf++;
-			addr++;
-			count--;
+		while ((vm = vmap_area_next_vm(va, &idx))) {
+			vaddr = (char *) vm->addr;
+			if (addr >= vaddr + get_vm_area_size(vm))
+				continue;
+			while (addr < vaddr) {
+				if (count == 0)
+					goto finished;
+				*buf = '\0';
+				buf++;
+				addr++;
+				count--;
+			}
+			n = vaddr + get_vm_area_size(vm) - addr;
+			if (n > count)
+				n = count;
+			if (!(vm->flags & VM_IOREMAP))
+				aligned_vread(buf, addr, n);
+			else /* IOREMAP area is treated as memory hole */
+				memset(buf, 0, n);
+			buf += n;
+			addr += n;
+			count -= n;
 		}
-		n = vaddr + get_vm_area_size(vm) - addr;
-		if (n > count)
-			n = count;
-		if (!(vm->flags & VM_IOREMAP))
-			aligned_vread(buf, addr, n);
-		else /* IOREMAP area is treated as memory hole */
-			memset(buf, 0, n);
-		buf += n;
-		addr += n;
-		count -= n;
 	}
 finished:
 	spin_unlock(&vmap_area_lock);
@@ -2397,33 +2623,33 @@ long vwrite(char *buf, char *addr, unsigned long count)
 
 	spin_lock(&vmap_area_lock);
 	list_for_each_entry(va, &vmap_area_list, list) {
+		unsigned long idx = 0;
+
 		if (!count)
 			break;
 
-		if (!(va->flags & VM_VM_AREA))
-			continue;
-
-		vm = va->vm;
-		vaddr = (char *) vm->addr;
-		if (addr >= vaddr + get_vm_area_size(vm))
-			continue;
-		while (addr < vaddr) {
-			if (count == 0)
-				goto finished;
-			buf++;
-			addr++;
-			count--;
-		}
-		n = vaddr + get_vm_area_size(vm) - addr;
-		if (n > count)
-			n = count;
-		if (!(vm->flags & VM_IOREMAP)) {
-			aligned_vwrite(buf, addr, n);
-			copied++;
+		while ((vm = vmap_area_next_vm(va, &idx))) {
+			vaddr = (char *) vm->addr;
+			if (addr >= vaddr + get_vm_area_size(vm))
+				continue;
+			while (addr < vaddr) {
+				if (count == 0)
+					goto finished;
+				buf++;
+				addr++;
+				count--;
+			}
+			n = vaddr + get_vm_area_size(vm) - addr;
+			if (n > count)
+				n = count;
+			if (!(vm->flags & VM_IOREMAP)) {
+				aligned_vwrite(buf, addr, n);
+				copied++;
+			}
+			buf += n;
+			addr += n;
+			count -= n;
 		}
-		buf += n;
-		addr += n;
-		count -= n;
 	}
 finished:
 	spin_unlock(&vmap_area_lock);
@@ -2898,22 +3124,8 @@ static void show_numa_info(struct seq_file *m, struct vm_struct *v)
 	}
 }
 
-static int s_show(struct seq_file *m, void *p)
+static void show_vm_area(struct seq_file *m, struct vm_struct *v)
 {
-	struct vmap_area *va;
-	struct vm_struct *v;
-
-	va = list_entry(p, struct vmap_area, list);
-
-	/*
-	 * s_show can encounter race with remove_vm_area, !VM_VM_AREA on
-	 * behalf of vmap area is being tear down or vm_map_ram allocation.
-	 */
-	if (!(va->flags & VM_VM_AREA))
-		return 0;
-
-	v = va->vm;
-
 	seq_printf(m, "0x%pK-0x%pK %7ld",
 		v->addr, v->addr + v->size, v->size);
 
@@ -2943,6 +3155,45 @@ static int s_show(struct seq_file *m, void *p)
 
 	show_numa_info(m, v);
 	seq_putc(m, '\n');
+}
+
+/* vmalloc areas living inside a per-CPU vmap block */
+static void show_vb_areas(struct seq_file *m, struct vmap_area *va)
+{
+	struct vmap_block *vb;
+	unsigned long i;
+
+	rcu_read_lock();
+	vb = radix_tree_lookup(&vmap_block_tree, addr_to_vb_idx(va->va_start));
+	if (vb && vb->vms) {
+		spin_lock(&vb->lock);
+		for (i = 0; i < VMAP_BBMAP_BITS; i++)
+			if (vb->vms[i])
+				show_vm_area(m, vb->vms[i]);
+		spin_unlock(&vb->lock);
+	}
+	rcu_read_unlock();
+}
+
+static int s_show(struct seq_file *m, void *p)
+{
+	struct vmap_area *va;
+
+	va = list_entry(p, struct vmap_area, list);
+
+	if (va->flags & VM_VB_AREA) {
+		show_vb_areas(m, va);
+		return 0;
+	}
+
+	/*
+	 * s_show can encounter race with remove_vm_area, !VM_VM_AREA on
+	 * behalf of vmap area is being tear down or vm_map_ram allocation.
+	 */
+	if (!(va->flags & VM_VM_AREA))
+		return 0;
+
+	show_vm_area(m, va->vm);
 	return 0;
 }
 
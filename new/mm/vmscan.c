@@ -47,6 +47,9 @@
 #include <linux/prefetch.h>
 #include <linux/printk.h>
 #include <linux/dax.h>
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/seq_file.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -922,14 +925,646 @@ enum page_references {
 	PAGEREF_ACTIVATE,
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generation LRU aging.
+ *
+ * With "lru_gen=1" on the command line, mapped pages are aged by
+ * generations instead of by rmap walks in page_referenced(). An aging
+ * pass bumps the lruvec's max_seq and walks the page tables of every mm
+ * of the lruvec's memcg, test-and-clearing accessed bits in one sweep
+ * per mm under a single mmap_sem hold. Pages of the lruvec found young
+ * are stamped with the new generation in page->flags; the accessed bits
+ * of other nodes' and memcgs' pages are left alone.
+ *
+ * A stamp only holds the sequence modulo LRU_GEN_NR_STAMPS, so max_seq
+ * never gets LRU_GEN_NR_STAMPS generations ahead of min_seq, the oldest
+ * sequence a stamp of the lruvec may still hold. kswapd raises min_seq
+ * with an age-out sweep of its node, a slice of the pfns at a time,
+ * which marks pages stamped MAX_NR_GENS or more generations ago as old.
+ * Stamps are only kept on pages that are on an LRU list: a page taken
+ * off keeps the age its stamp stood for instead, and is stamped again
+ * from that age by the lruvec it is put back on.
+ *
+ * shrink_active_list() and page_check_references() then decide on mapped
+ * pages from the stamp. A walk only sees the memcg's own mms and skips
+ * mms whose mmap_sem is contended, so "not seen young" is trusted only
+ * for pages mapped once, and only after a walk that skipped nothing.
+ * Other pages, pages mapped since the last pass and unmapped page cache
+ * still take the rmap path.
+ *
+ * Passes are made by kswapd, at most once per LRU_GEN_MIN_INTERVAL and
+ * by one walker per lruvec.
+ */
+#define LRU_GEN_WIDTH		4
+#define LRU_GEN_MASK		(((1UL << LRU_GEN_WIDTH) - 1) << PG_lru_gen)
+#define LRU_GEN_NR_STAMPS	((1 << LRU_GEN_WIDTH) - MAX_NR_GENS - 2)
+#define LRU_GEN_OLD		(LRU_GEN_NR_STAMPS + 1)
+#define LRU_GEN_HELD		(LRU_GEN_NR_STAMPS + 2)
+#define LRU_GEN_MIN_INTERVAL	HZ
+#define LRU_GEN_SWEEP_STEPS	4
+#define LRU_GEN_MM_HASH_BITS	6
+
+static bool lru_gen_enabled __read_mostly;
+
+static int __init setup_lru_gen(char *str)
+{
+	return !kstrtobool(str, &lru_gen_enabled);
+}
+__setup("lru_gen=", setup_lru_gen);
+
+/*
+ * The mms of a memcg are on the list its pointer hashes to. An mm whose
+ * task moved to another memcg is refiled when a walk comes across it on
+ * its old list, or when the round of lru_gen_mm_refile reaches that list.
+ */
+static struct hlist_head lru_gen_mm_lists[1 << LRU_GEN_MM_HASH_BITS];
+static unsigned int lru_gen_mm_refile;
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+
+static struct hlist_head *lru_gen_mm_list(struct mem_cgroup *memcg)
+{
+	return &lru_gen_mm_lists[hash_ptr(memcg, LRU_GEN_MM_HASH_BITS)];
+}
+
+/* The memcg walks of @mm are made for; only hashed and compared */
+static struct mem_cgroup *lru_gen_mm_memcg(struct mm_struct *mm)
+{
+#ifdef CONFIG_MEMCG
+	struct mem_cgroup *memcg;
+
+	if (mem_cgroup_disabled())
+		return NULL;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(rcu_dereference(mm->owner));
+	rcu_read_unlock();
+	return memcg ? : root_mem_cgroup;
+#else
+	return NULL;
+#endif
+}
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	if (!lru_gen_enabled)
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	mm->lru_gen_memcg = lru_gen_mm_memcg(mm);
+	hlist_add_head(&mm->lru_gen_node, lru_gen_mm_list(mm->lru_gen_memcg));
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	if (hlist_unhashed(&mm->lru_gen_node))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	hlist_del_init(&mm->lru_gen_node);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/* Move @mm to the list of its current memcg and return that memcg */
+static struct mem_cgroup *lru_gen_refile_mm(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg = lru_gen_mm_memcg(mm);
+	struct hlist_head *head;
+
+	lockdep_assert_held(&lru_gen_mm_lock);
+
+	if (memcg == mm->lru_gen_memcg)
+		return memcg;
+
+	head = lru_gen_mm_list(memcg);
+	if (head != lru_gen_mm_list(mm->lru_gen_memcg)) {
+		hlist_del(&mm->lru_gen_node);
+		hlist_add_head(&mm->lru_gen_node, head);
+	}
+	mm->lru_gen_memcg = memcg;
+	return memcg;
+}
+
+/*
+ * 0: never stamped, 1..LRU_GEN_NR_STAMPS: generation, LRU_GEN_OLD: aged
+ * out, LRU_GEN_HELD + age: off the LRU lists, seen young age passes ago
+ */
+static inline int page_lru_gen(struct page *page)
+{
+	return (READ_ONCE(page->flags) & LRU_GEN_MASK) >> PG_lru_gen;
+}
+
+/*
+ * Change the stamp of @page from @old_gen to @new_gen, unless either the
+ * stamp or whether the page is on an LRU list (@lru) changed meanwhile.
+ */
+static void page_lru_gen_update(struct page *page, int old_gen, int new_gen,
+				bool lru)
+{
+	unsigned long old_flags, new_flags;
+
+	do {
+		old_flags = READ_ONCE(page->flags);
+		if (((old_flags & LRU_GEN_MASK) >> PG_lru_gen) != old_gen ||
+		    !(old_flags & BIT(PG_lru)) == lru)
+			return;
+		new_flags = (old_flags & ~LRU_GEN_MASK) |
+			    ((unsigned long)new_gen << PG_lru_gen);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % LRU_GEN_NR_STAMPS + 1;
+}
+
+/*
+ * Number of aging passes since the page was last seen young, relative to
+ * max_seq and capped at MAX_NR_GENS, which also stands for pages that
+ * aged out. Returns -1 for pages that were never stamped.
+ */
+static int lru_gen_age(unsigned long max_seq, int gen)
+{
+	int age;
+
+	if (!gen)
+		return -1;
+	if (gen >= LRU_GEN_HELD)
+		return gen - LRU_GEN_HELD;
+	if (gen == LRU_GEN_OLD)
+		return MAX_NR_GENS;
+
+	age = (max_seq % LRU_GEN_NR_STAMPS + LRU_GEN_NR_STAMPS - (gen - 1)) %
+	      LRU_GEN_NR_STAMPS;
+	return min(age, MAX_NR_GENS);
+}
+
+/*
+ * @page was taken off its LRU list: keep the age its stamp stands for,
+ * which stays right however far max_seq moves on meanwhile.
+ */
+static void lru_gen_isolate_page(struct page *page)
+{
+	struct lruvec *lruvec;
+	int gen, age;
+
+	gen = page_lru_gen(page);
+	if (!gen || gen > LRU_GEN_NR_STAMPS)
+		return;
+
+	lruvec = mem_cgroup_page_lruvec(page, page_pgdat(page));
+	age = lru_gen_age(READ_ONCE(lruvec->lrugen.max_seq), gen);
+	if (age < MAX_NR_GENS)
+		page_lru_gen_update(page, gen, LRU_GEN_HELD + age, false);
+	else
+		page_lru_gen_update(page, gen, LRU_GEN_OLD, false);
+}
+
+/*
+ * @page is about to go back on a list of @lruvec: stamp it from the age
+ * it kept. Called under lru_lock, before SetPageLRU().
+ */
+void lru_gen_putback_page(struct page *page, struct lruvec *lruvec)
+{
+	unsigned long max_seq = READ_ONCE(lruvec->lrugen.max_seq);
+	int gen, age;
+
+	gen = page_lru_gen(page);
+	if (gen < LRU_GEN_HELD)
+		return;
+
+	/* A young lruvec has no generation that old: leave it to the rmap */
+	age = gen - LRU_GEN_HELD;
+	if (age <= max_seq)
+		page_lru_gen_update(page, gen, lru_gen_from_seq(max_seq - age),
+				    false);
+	else
+		page_lru_gen_update(page, gen, 0, false);
+}
+
+/*
+ * Generations since @page was last seen young, or -1 when the stamp is no
+ * guide: the page is not mapped, or it looks cold but the walks may have
+ * missed some of its mappings.
+ */
+static int page_lru_gen_age(struct page *page)
+{
+	struct lruvec *lruvec;
+	int age;
+
+	if (!lru_gen_enabled || !page_mapped(page))
+		return -1;
+
+	lruvec = mem_cgroup_page_lruvec(page, page_pgdat(page));
+	age = lru_gen_age(READ_ONCE(lruvec->lrugen.max_seq),
+			  page_lru_gen(page));
+	if (age >= MAX_NR_GENS / 2 &&
+	    (page_mapcount(page) > 1 || READ_ONCE(lruvec->lrugen.nr_skipped)))
+		return -1;
+	return age;
+}
+
+/*
+ * Age out the next slice of @pgdat's pfns, one slice per
+ * LRU_GEN_MIN_INTERVAL, so a sweep of the node takes LRU_GEN_SWEEP_STEPS
+ * intervals whatever the number of memcgs. A page on an LRU list whose
+ * stamp is MAX_NR_GENS or more generations old on its lruvec is marked
+ * old. Once a sweep is over, no lruvec holds a stamp older than
+ * MAX_NR_GENS - 1 generations before the max_seq it had when the sweep
+ * began, and min_seq moves up to that. Only the node's kswapd sweeps.
+ */
+static void lru_gen_sweep(struct pglist_data *pgdat)
+{
+	unsigned long pfn, end_pfn, seq;
+	struct mem_cgroup *memcg;
+	struct lruvec *lruvec;
+
+	if (pgdat->lru_gen_sweep_time &&
+	    time_before(jiffies, pgdat->lru_gen_sweep_time +
+				 LRU_GEN_MIN_INTERVAL))
+		return;
+	pgdat->lru_gen_sweep_time = jiffies;
+
+	if (!pgdat->lru_gen_sweep_pfn) {
+		memcg = mem_cgroup_iter(NULL, NULL, NULL);
+		do {
+			lruvec = mem_cgroup_lruvec(pgdat, memcg);
+			lruvec->lrugen.sweep_seq = lruvec->lrugen.max_seq;
+		} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+	}
+
+	pfn = pgdat->node_start_pfn + pgdat->lru_gen_sweep_pfn;
+	end_pfn = min(pfn + DIV_ROUND_UP(pgdat->node_spanned_pages,
+					 LRU_GEN_SWEEP_STEPS),
+		      pgdat_end_pfn(pgdat));
+	for (; pfn < end_pfn; pfn++) {
+		struct page *page;
+		int gen;
+
+		if (!(pfn % pageblock_nr_pages))
+			cond_resched();
+		if (!pfn_valid(pfn))
+			continue;
+
+		page = pfn_to_page(pfn);
+		gen = page_lru_gen(page);
+		if (!gen || gen > LRU_GEN_NR_STAMPS ||
+		    !PageLRU(page) || page_pgdat(page) != pgdat)
+			continue;
+
+		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		if (lru_gen_age(lruvec->lrugen.max_seq, gen) >= MAX_NR_GENS)
+			page_lru_gen_update(page, gen, LRU_GEN_OLD, true);
+	}
+
+	if (end_pfn < pgdat_end_pfn(pgdat)) {
+		pgdat->lru_gen_sweep_pfn = end_pfn - pgdat->node_start_pfn;
+		return;
+	}
+	pgdat->lru_gen_sweep_pfn = 0;
+
+	/* A memcg created during the sweep still has sweep_seq 0 */
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct lru_gen_struct *lrugen;
+
+		lrugen = &mem_cgroup_lruvec(pgdat, memcg)->lrugen;
+		seq = lrugen->sweep_seq + 1;
+		if (seq >= MAX_NR_GENS + lrugen->min_seq)
+			lrugen->min_seq = seq - MAX_NR_GENS;
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+}
+
+struct lru_gen_walk {
+	struct lruvec *lruvec;
+	struct pglist_data *pgdat;
+	unsigned long seq;
+	unsigned long nr_pages[MAX_NR_GENS + 1][2];
+};
+
+/*
+ * Head page of @page if it is on the lruvec being aged, NULL otherwise.
+ * Checked before the accessed bit is harvested, which would otherwise be
+ * lost to the page's own lruvec and to page_referenced().
+ */
+static struct page *lru_gen_walk_filter(struct page *page,
+					struct lru_gen_walk *priv)
+{
+	page = compound_head(page);
+	if (!PageLRU(page) || PageUnevictable(page) ||
+	    page_pgdat(page) != priv->pgdat ||
+	    mem_cgroup_page_lruvec(page, priv->pgdat) != priv->lruvec)
+		return NULL;
+	return page;
+}
+
+static void lru_gen_walk_page(struct page *page, bool young,
+			      struct lru_gen_walk *priv)
+{
+	int gen, age;
+
+	gen = page_lru_gen(page);
+	if (young) {
+		page_lru_gen_update(page, gen, lru_gen_from_seq(priv->seq),
+				    true);
+		gen = lru_gen_from_seq(priv->seq);
+	}
+
+	age = lru_gen_age(priv->seq, gen);
+	if (age < 0)
+		age = MAX_NR_GENS;
+	priv->nr_pages[age][page_is_file_cache(page)] += hpage_nr_pages(page);
+}
+
+static int lru_gen_pmd_entry(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *priv = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	struct page *page;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		if (pmd_present(*pmd) && !is_huge_zero_pmd(*pmd)) {
+			page = lru_gen_walk_filter(pmd_page(*pmd), priv);
+			if (page)
+				lru_gen_walk_page(page,
+					pmdp_test_and_clear_young(vma, addr, pmd),
+					priv);
+		}
+		spin_unlock(ptl);
+		return 0;
+	}
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+		page = lru_gen_walk_filter(page, priv);
+		if (!page)
+			continue;
+
+		lru_gen_walk_page(page,
+			ptep_test_and_clear_young(vma, addr, pte), priv);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static int lru_gen_test_walk(unsigned long start, unsigned long end,
+			     struct mm_walk *walk)
+{
+	/* Nothing on the evictable LRU lists to age here */
+	if (walk->vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_HUGETLB))
+		return 1;
+	return 0;
+}
+
+/*
+ * Start a new generation and stamp the pages of @lruvec that were accessed
+ * since the previous one. Rate limited to one pass per LRU_GEN_MIN_INTERVAL,
+ * and held back while the age-out sweep has yet to catch up with min_seq;
+ * lrugen->walking keeps a walk that outlasts the interval from overlapping
+ * the next one.
+ */
+static void lru_gen_age_lruvec(struct lruvec *lruvec, struct mem_cgroup *memcg)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct lru_gen_walk priv = {
+		.lruvec = lruvec,
+		.pgdat = lruvec_pgdat(lruvec),
+	};
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_pmd_entry,
+		.test_walk = lru_gen_test_walk,
+		.private = &priv,
+	};
+	struct hlist_head *head = lru_gen_mm_list(memcg), *refile;
+	struct hlist_node *pos, *n;
+	struct mm_struct *mm, *prev = NULL;
+	unsigned long seq, nr_skipped = 0;
+
+	if (!lru_gen_enabled)
+		return;
+
+	lru_gen_sweep(priv.pgdat);
+	if (test_and_set_bit_lock(0, &lrugen->walking))
+		return;
+
+	seq = lrugen->max_seq;
+	if (seq && time_before(jiffies, lrugen->timestamp +
+					LRU_GEN_MIN_INTERVAL))
+		goto unlock;
+	if (seq + 1 - lrugen->min_seq >= LRU_GEN_NR_STAMPS)
+		goto unlock;
+
+	priv.seq = seq + 1;
+	WRITE_ONCE(lrugen->max_seq, priv.seq);
+	WRITE_ONCE(lrugen->timestamp, jiffies);
+
+	spin_lock(&lru_gen_mm_lock);
+	refile = &lru_gen_mm_lists[lru_gen_mm_refile++ %
+				   ARRAY_SIZE(lru_gen_mm_lists)];
+	hlist_for_each_entry_safe(mm, n, refile, lru_gen_node)
+		lru_gen_refile_mm(mm);
+
+	hlist_for_each_safe(pos, n, head) {
+		mm = hlist_entry(pos, struct mm_struct, lru_gen_node);
+		if (lru_gen_refile_mm(mm) != memcg || !mmget_not_zero(mm))
+			continue;
+		/*
+		 * Our reference keeps mm on a list, so the iteration can
+		 * resume from it once the lock is retaken, unless it was
+		 * refiled to another memcg's list meanwhile.
+		 */
+		spin_unlock(&lru_gen_mm_lock);
+		if (prev)
+			mmput_async(prev);
+		prev = mm;
+
+		if (down_read_trylock(&mm->mmap_sem)) {
+			walk.mm = mm;
+			walk_page_range(0, mm->highest_vm_end, &walk);
+			up_read(&mm->mmap_sem);
+		} else {
+			nr_skipped++;
+		}
+		cond_resched();
+		spin_lock(&lru_gen_mm_lock);
+		if (lru_gen_mm_list(mm->lru_gen_memcg) != head) {
+			nr_skipped++;
+			break;
+		}
+		n = pos->next;
+	}
+	spin_unlock(&lru_gen_mm_lock);
+	if (prev)
+		mmput_async(prev);
+
+	memcpy(lrugen->nr_pages, priv.nr_pages, sizeof(priv.nr_pages));
+	WRITE_ONCE(lrugen->nr_skipped, nr_skipped);
+unlock:
+	clear_bit_unlock(0, &lrugen->walking);
+}
+
+/*
+ * 1: seen young in the last half of the generations, 0: not seen young
+ * since, -1: the stamp is no guide and the rmap has to be asked.
+ */
+static int lru_gen_page_active(struct page *page)
+{
+	int age = page_lru_gen_age(page);
+
+	if (age < 0)
+		return -1;
+	return age < MAX_NR_GENS / 2;
+}
+
+static void lru_gen_note_eviction(struct page *page, struct pglist_data *pgdat)
+{
+	struct lruvec *lruvec;
+	int age;
+
+	if (!lru_gen_enabled)
+		return;
+
+	lruvec = mem_cgroup_page_lruvec(page, pgdat);
+	age = lru_gen_age(READ_ONCE(lruvec->lrugen.max_seq), page_lru_gen(page));
+	if (age < 0)
+		age = MAX_NR_GENS;
+	atomic_long_inc(&lruvec->lrugen.nr_evicted[age][page_is_file_cache(page)]);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int lru_gen_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg;
+	int nid, age;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		for_each_node_state(nid, N_MEMORY) {
+			struct lruvec *lruvec;
+			struct lru_gen_struct *lrugen;
+
+			lruvec = mem_cgroup_lruvec(NODE_DATA(nid), memcg);
+			lrugen = &lruvec->lrugen;
+#ifdef CONFIG_MEMCG
+			seq_printf(m,
+				   "memcg %5hu node %d max_seq %lu min_seq %lu\n",
+				   memcg ? mem_cgroup_id(memcg) : 0, nid,
+				   READ_ONCE(lrugen->max_seq),
+				   READ_ONCE(lrugen->min_seq));
+#else
+			seq_printf(m, "node %d max_seq %lu min_seq %lu\n", nid,
+				   READ_ONCE(lrugen->max_seq),
+				   READ_ONCE(lrugen->min_seq));
+#endif
+			seq_puts(m, "  age        anon        file"
+				    "  evict_anon  evict_file\n");
+			for (age = 0; age <= MAX_NR_GENS; age++) {
+				if (age < MAX_NR_GENS)
+					seq_printf(m, "  %3d", age);
+				else
+					seq_puts(m, "  old");
+				seq_printf(m, " %11lu %11lu %11ld %11ld\n",
+					   lrugen->nr_pages[age][0],
+					   lrugen->nr_pages[age][1],
+					   atomic_long_read(&lrugen->nr_evicted[age][0]),
+					   atomic_long_read(&lrugen->nr_evicted[age][1]));
+			}
+		}
+		cond_resched();
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+
+	return 0;
+}
+
+static int lru_gen_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_gen_show, NULL);
+}
+
+static const struct file_operations lru_gen_fops = {
+	.open		= lru_gen_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init lru_gen_debugfs(void)
+{
+	if (!lru_gen_enabled)
+		return 0;
+
+	if (!debugfs_create_file("lru_gen", 0400, NULL, NULL, &lru_gen_fops))
+		return -ENOMEM;
+	return 0;
+}
+late_initcall(lru_gen_debugfs);
+#endif /* CONFIG_DEBUG_FS */
+#else
+static inline void lru_gen_isolate_page(struct page *page)
+{
+}
+
+static inline void lru_gen_age_lruvec(struct lruvec *lruvec,
+				      struct mem_cgroup *memcg)
+{
+}
+
+static inline int lru_gen_page_active(struct page *page)
+{
+	return -1;
+}
+
+static inline int page_lru_gen_age(struct page *page)
+{
+	return -1;
+}
+
+static inline void lru_gen_note_eviction(struct page *page,
+					 struct pglist_data *pgdat)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
 static enum page_references page_check_references(struct page *page,
 						  struct scan_control *sc)
 {
 	int referenced_ptes, referenced_page;
 	unsigned long vm_flags;
 
-	referenced_ptes = page_referenced(page, 1, sc->target_mem_cgroup,
-					  &vm_flags);
+	/*
+	 * Multi-gen LRU: reactivate pages accessed in the last generation
+	 * and leave the next-youngest on the inactive list for another
+	 * trip. The older ones were not seen young for several passes, so
+	 * they skip the rmap walk but still get the PageReferenced() second
+	 * chance below.
+	 */
+	switch (lru_gen_page_active(page)) {
+	case 1:
+		return page_lru_gen_age(page) ? PAGEREF_KEEP : PAGEREF_ACTIVATE;
+	case 0:
+		referenced_ptes = 0;
+		vm_flags = 0;
+		break;
+	default:
+		referenced_ptes = page_referenced(page, 1, sc->target_mem_cgroup,
+						  &vm_flags);
+		break;
+	}
 	referenced_page = TestClearPageReferenced(page);
 
 	/*
@@ -1392,6 +2027,7 @@ free_it:
 		if (ret == SWAP_LZFREE)
 			count_vm_event(PGLAZYFREED);
 
+		lru_gen_note_eviction(page, pgdat);
 		nr_reclaimed++;
 
 		/*
@@ -1544,6 +2180,7 @@ int __isolate_lru_page(struct page *page, isolate_mode_t mode)
 		 * page release code relies on it.
 		 */
 		ClearPageLRU(page);
+		lru_gen_isolate_page(page);
 		ret = 0;
 	}
 
@@ -1723,6 +2360,7 @@ int isolate_lru_page(struct page *page)
 			int lru = page_lru(page);
 			get_page(page);
 			ClearPageLRU(page);
+			lru_gen_isolate_page(page);
 			del_page_from_lru_list(page, lruvec, lru);
 			ret = 0;
 		}
@@ -1793,6 +2431,7 @@ putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 
 		lruvec = mem_cgroup_page_lruvec(page, pgdat);
 
+		lru_gen_putback_page(page, lruvec);
 		SetPageLRU(page);
 		lru = page_lru(page);
 		add_page_to_lru_list(page, lruvec, lru);
@@ -2021,6 +2660,7 @@ static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
 		lruvec = mem_cgroup_page_lruvec(page, pgdat);
 
 		VM_BUG_ON_PAGE(PageLRU(page), page);
+		lru_gen_putback_page(page, lruvec);
 		SetPageLRU(page);
 
 		nr_pages = hpage_nr_pages(page);
@@ -2065,6 +2705,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
 	unsigned nr_deactivate, nr_activate;
 	unsigned nr_rotated = 0;
+	int active;
 	isolate_mode_t isolate_mode = 0;
 	int file = is_file_lru(lru);
 	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
@@ -2118,8 +2759,19 @@ static void shrink_active_list(unsigned long nr_to_scan,
 			}
 		}
 
-		if (page_referenced(page, 0, sc->target_mem_cgroup,
-				    &vm_flags)) {
+		/*
+		 * Multi-gen LRU keeps the policy below: only referenced
+		 * VM_EXEC file pages stay active. The stamp answers the
+		 * "referenced" half, so anon pages and pages not seen young
+		 * are deactivated without a rmap walk, and only young file
+		 * pages are asked for their vm_flags.
+		 */
+		active = lru_gen_page_active(page);
+		if (active == 1 && !page_is_file_cache(page)) {
+			nr_rotated += hpage_nr_pages(page);
+		} else if (active != 0 &&
+			 page_referenced(page, 0, sc->target_mem_cgroup,
+					 &vm_flags)) {
 			nr_rotated += hpage_nr_pages(page);
 			/*
 			 * Identify referenced, file-backed active pages and
@@ -2495,6 +3147,10 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	/* Aging walks every mm of the memcg: too slow for direct reclaim */
+	if (current_is_kswapd())
+		lru_gen_age_lruvec(lruvec, memcg);
+
 	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
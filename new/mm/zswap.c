@@ -47,6 +47,7 @@
 #include <linux/swapops.h>
 #include <linux/writeback.h>
 #include <linux/pagemap.h>
+#include <linux/blkdev.h>
 
 /*********************************
 * statistics
@@ -55,6 +56,8 @@
 static u64 zswap_pool_total_size;
 /* The number of compressed pages currently stored in zswap */
 static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+/* The number of same-value filled pages currently stored in zswap */
+static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /*
  * The statistics below are not protected from concurrent access for
@@ -77,6 +80,12 @@ static u64 zswap_reject_alloc_fail;
 static u64 zswap_reject_kmemcache_fail;
 /* Duplicate store was encountered (rare) */
 static u64 zswap_duplicate_entry;
+/* Stores satisfied by the same-value filled page path */
+static u64 zswap_same_filled_hit;
+/* Number of batched writeback passes issued by zswap_shrink() */
+static u64 zswap_writeback_batches;
+/* Largest number of pages written back by a single batch */
+static u64 zswap_writeback_batch_max;
 
 /*********************************
 * tunables
@@ -120,6 +129,15 @@ module_param_cb(zpool, &zswap_zpool_param_ops, &zswap_zpool_type, 0644);
 static unsigned int zswap_max_pool_percent = 20;
 module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
 
+/* Enable/disable handling same-value filled pages (enabled by default) */
+static bool zswap_same_filled_pages_enabled = true;
+module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
+		   bool, 0644);
+
+/* Number of zpool pages reclaimed per writeback batch */
+static unsigned int zswap_writeback_batch = 8;
+module_param_named(writeback_batch, zswap_writeback_batch, uint, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -149,9 +167,10 @@ struct zswap_pool {
  *            be held while changing the refcount.  Since the lock must
  *            be held, there is no reason to also make refcount atomic.
  * length - the length in bytes of the compressed page data.  Needed during
- *          decompression
+ *          decompression.  A length of 0 marks a same-value filled page.
  * pool - the zswap_pool the entry's data is in
  * handle - zpool allocation handle that stores the compressed page data
+ * value - the word the page is filled with, valid when length is 0
  */
 struct zswap_entry {
 	struct rb_node rbnode;
@@ -159,7 +178,10 @@ struct zswap_entry {
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
-	unsigned long handle;
+	union {
+		unsigned long handle;
+		unsigned long value;
+	};
 };
 
 struct zswap_header {
@@ -321,8 +343,12 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
-	zpool_free(entry->pool->zpool, entry->handle);
-	zswap_pool_put(entry->pool);
+	if (!entry->length)
+		atomic_dec(&zswap_same_filled_pages);
+	else {
+		zpool_free(entry->pool->zpool, entry->handle);
+		zswap_pool_put(entry->pool);
+	}
 	zswap_entry_cache_free(entry);
 	atomic_dec(&zswap_stored_pages);
 	zswap_update_total_size();
@@ -892,20 +918,69 @@ end:
 	return ret;
 }
 
+/*
+ * Reclaims up to zswap_writeback_batch zpool pages from the oldest pool.
+ * Each evicted entry is decompressed into the swap cache and submitted
+ * by zswap_writeback_entry(); the writes are issued under a single plug
+ * so that neighbouring swap slots are merged into larger bios before
+ * they reach the device.  Succeeds if at least one page was reclaimed.
+ */
 static int zswap_shrink(void)
 {
 	struct zswap_pool *pool;
+	struct blk_plug plug;
+	unsigned int batch = max(zswap_writeback_batch, 1U);
+	unsigned int reclaimed = 0;
+	u64 written;
 	int ret;
 
 	pool = zswap_pool_last_get();
 	if (!pool)
 		return -ENOENT;
 
-	ret = zpool_shrink(pool->zpool, 1, NULL);
+	written = zswap_written_back_pages;
+	blk_start_plug(&plug);
+	ret = zpool_shrink(pool->zpool, batch, &reclaimed);
+	blk_finish_plug(&plug);
+	written = zswap_written_back_pages - written;
+
+	zswap_writeback_batches++;
+	if (written > zswap_writeback_batch_max)
+		zswap_writeback_batch_max = written;
 
 	zswap_pool_put(pool);
 
-	return ret;
+	return reclaimed ? 0 : ret;
+}
+
+/*
+ * Returns true if the page consists of a single repeated word, which is
+ * then stored in *value.
+ */
+static bool zswap_is_page_same_filled(void *ptr, unsigned long *value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
+			return false;
+	}
+	*value = page[0];
+	return true;
+}
+
+static void zswap_fill_page(void *ptr, unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	if (!value) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = value;
 }
 
 /*********************************
@@ -924,14 +999,22 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	char *buf;
 	u8 *src, *dst;
 	struct zswap_header *zhdr;
+	unsigned long value;
+	bool same_filled = false;
 
 	if (!zswap_enabled || !tree) {
 		ret = -ENODEV;
 		goto reject;
 	}
 
-	/* reclaim space if needed */
-	if (zswap_is_full()) {
+	if (zswap_same_filled_pages_enabled) {
+		src = kmap_atomic(page);
+		same_filled = zswap_is_page_same_filled(src, &value);
+		kunmap_atomic(src);
+	}
+
+	/* reclaim space if needed, a same-value filled page takes none */
+	if (!same_filled && zswap_is_full()) {
 		zswap_pool_limit_hit++;
 		if (zswap_shrink()) {
 			zswap_reject_reclaim_fail++;
@@ -948,6 +1031,15 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
+	if (same_filled) {
+		entry->offset = offset;
+		entry->length = 0;
+		entry->value = value;
+		zswap_same_filled_hit++;
+		atomic_inc(&zswap_same_filled_pages);
+		goto insert_entry;
+	}
+
 	/* if entry is successfully added, it keeps the reference */
 	entry->pool = zswap_pool_current_get();
 	if (!entry->pool) {
@@ -992,6 +1084,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	entry->handle = handle;
 	entry->length = dlen;
 
+insert_entry:
 	/* map */
 	spin_lock(&tree->lock);
 	do {
@@ -1044,6 +1137,13 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	}
 	spin_unlock(&tree->lock);
 
+	if (!entry->length) {
+		dst = kmap_atomic(page);
+		zswap_fill_page(dst, entry->value);
+		kunmap_atomic(dst);
+		goto freeentry;
+	}
+
 	/* decompress */
 	dlen = PAGE_SIZE;
 	src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
@@ -1056,6 +1156,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	zpool_unmap_handle(entry->pool->zpool, entry->handle);
 	BUG_ON(ret);
 
+freeentry:
 	spin_lock(&tree->lock);
 	zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
@@ -1164,6 +1265,14 @@ static int __init zswap_debugfs_init(void)
 			zswap_debugfs_root, &zswap_pool_total_size);
 	debugfs_create_atomic_t("stored_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_stored_pages);
+	debugfs_create_atomic_t("same_filled_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_same_filled_pages);
+	debugfs_create_u64("same_filled_hit", S_IRUGO,
+			zswap_debugfs_root, &zswap_same_filled_hit);
+	debugfs_create_u64("writeback_batches", S_IRUGO,
+			zswap_debugfs_root, &zswap_writeback_batches);
+	debugfs_create_u64("writeback_batch_max", S_IRUGO,
+			zswap_debugfs_root, &zswap_writeback_batch_max);
 
 	return 0;
 }